@@ -53,6 +53,8 @@ def main():
     print(f"\nError relative to naive:")
     print(f"  MSE       = {stats['mse']:.6f}")
     print(f"  Max error = {stats['max_error']:.6f}")
+    print(f"  Cosine    = {stats['cosine']:.6f}")
+    print(f"  SNR (dB)  = {stats['snr_db']:.2f}")
 
 if __name__ == "__main__":
     main()
\ No newline at end of file
@@ -1,24 +1,204 @@
 #pragma once
 #include <vector>
+#include <array>
 #include <cmath>
 #include <cstddef>
+#include <cstdint>
 #include <algorithm>
+#include <limits>
+#include <mutex>
+#include <thread>
+#include <stdexcept>
+
+// Decade histogram of absolute errors:
+//   bin 0        : |d| < 1e-9
+//   bin 1 … 10   : [1e-9, 1e-8) … [1, 10)
+//   bin 11       : |d| ≥ 10, or non-finite (NaN / ±inf)
+constexpr size_t kErrorHistBins = 12;
 
 struct ErrorStats {
-    double mse;
-    double max_error;
+    double mse = 0.0;
+    double max_error = 0.0;       // max |test - ref|
+    double max_rel_error = 0.0;   // max |test - ref| / max(|ref|, 1e-6)
+    double cosine = 1.0;          // cosine similarity of ref and test
+    double snr_db = std::numeric_limits<double>::infinity();  // 10·log10(Σref² / Σerr²)
+    size_t count = 0;
+    size_t nonfinite = 0;         // elements whose error is NaN or ±inf
+    std::array<uint64_t, kErrorHistBins> histogram{};
+
+    // Lower edge of histogram bin b (bin 0 starts at 0)
+    static double bin_lower_edge(size_t b) {
+        return b == 0 ? 0.0 : std::pow(10.0, double(b) - 10.0);
+    }
+};
+
+// =============================================================
+//  Streaming error accumulator — single pass over ref/test,
+//  vectorized inner loop, optional worker threads for large
+//  buffers. update() may be called tile-by-tile (even from
+//  several GEMM workers at once); stats() finalises at any point.
+// =============================================================
+class ErrorAccumulator {
+public:
+    ErrorAccumulator() = default;
+    ErrorAccumulator(const ErrorAccumulator& o) { merge(o); }
+    ErrorAccumulator& operator=(const ErrorAccumulator& o) {
+        if (this != &o) { reset(); merge(o); }
+        return *this;
+    }
+
+    // Contiguous span of n values
+    void update(const float* ref, const float* test, size_t n,
+                size_t num_threads = 1) {
+        update_tile(ref, test, 1, n, n, n, num_threads);
+    }
+
+    // rows × cols tile with leading dimensions ld_ref / ld_test
+    void update_tile(const float* ref, const float* test,
+                     size_t rows, size_t cols,
+                     size_t ld_ref, size_t ld_test,
+                     size_t num_threads = 1) {
+        const size_t total = rows * cols;
+        // threads only pay off on large tiles
+        num_threads = std::max<size_t>(1, std::min(num_threads, total / kMinPerThread));
+
+        std::vector<Partial> parts(num_threads);
+        auto work = [&](size_t t) {
+            size_t r0 = rows * t / num_threads, r1 = rows * (t + 1) / num_threads;
+            if (rows == 1) {   // split a single long row by columns instead
+                size_t c0 = cols * t / num_threads, c1 = cols * (t + 1) / num_threads;
+                parts[t].accumulate(ref + c0, test + c0, c1 - c0);
+                return;
+            }
+            for (size_t r = r0; r < r1; ++r)
+                parts[t].accumulate(ref + r * ld_ref, test + r * ld_test, cols);
+        };
+        if (num_threads == 1) {
+            work(0);
+        } else {
+            std::vector<std::thread> threads;
+            for (size_t t = 0; t < num_threads; ++t) threads.emplace_back(work, t);
+            for (auto& thr : threads) thr.join();
+        }
+
+        std::lock_guard<std::mutex> lock(mtx_);
+        for (auto& p : parts) total_.merge(p);
+    }
+
+    void merge(const ErrorAccumulator& o) {
+        Partial p;
+        {
+            std::lock_guard<std::mutex> lock(o.mtx_);
+            p = o.total_;
+        }
+        std::lock_guard<std::mutex> lock(mtx_);
+        total_.merge(p);
+    }
+
+    void reset() {
+        std::lock_guard<std::mutex> lock(mtx_);
+        total_ = Partial{};
+    }
+
+    ErrorStats stats() const {
+        std::lock_guard<std::mutex> lock(mtx_);
+        const Partial& p = total_;
+        ErrorStats s;
+        s.count = p.count;
+        s.histogram = p.hist;
+        s.max_error = p.max_abs;
+        s.max_rel_error = p.max_rel;
+        s.nonfinite = p.nonfinite;
+        if (p.count == 0) return s;
+        s.mse = p.sum_sq_err / double(p.count);
+        if (p.sum_sq_ref > 0.0 && p.sum_sq_test > 0.0)
+            s.cosine = p.sum_dot / std::sqrt(p.sum_sq_ref * p.sum_sq_test);
+        else if (p.sum_sq_ref != p.sum_sq_test)
+            s.cosine = 0.0;      // exactly one side is all zeros
+        if (p.sum_sq_err > 0.0)
+            s.snr_db = 10.0 * std::log10(p.sum_sq_ref / p.sum_sq_err);
+        if (p.nonfinite > 0) {   // max() and the sums would otherwise drop NaNs
+            s.max_error = s.max_rel_error = std::numeric_limits<double>::infinity();
+            s.snr_db = -std::numeric_limits<double>::infinity();
+        }
+        return s;
+    }
+
+private:
+    static constexpr size_t kMinPerThread = 1 << 16;
+    static constexpr size_t kChunk = 1024;
+
+    struct Partial {
+        double sum_sq_err = 0.0, sum_sq_ref = 0.0, sum_sq_test = 0.0, sum_dot = 0.0;
+        double max_abs = 0.0, max_rel = 0.0;
+        size_t count = 0, nonfinite = 0;
+        std::array<uint64_t, kErrorHistBins> hist{};
+
+        void accumulate(const float* ref, const float* test, size_t n) {
+            static const float thr[kErrorHistBins - 1] = {
+                1e-9f, 1e-8f, 1e-7f, 1e-6f, 1e-5f, 1e-4f,
+                1e-3f, 1e-2f, 1e-1f, 1e0f,  1e1f };
+            uint8_t bins[kChunk];
+            for (size_t base = 0; base < n; base += kChunk) {
+                size_t len = std::min(kChunk, n - base);
+                const float* r = ref + base;
+                const float* x = test + base;
+                double se = 0.0, sr = 0.0, st = 0.0, sd = 0.0, ma = 0.0, mr = 0.0;
+                size_t nf = 0;
+#pragma omp simd reduction(+:se,sr,st,sd,nf) reduction(max:ma,mr)
+                for (size_t i = 0; i < len; ++i) {
+                    double rv = r[i], xv = x[i];
+                    double d  = xv - rv;
+                    double ad = std::fabs(d);
+                    se += d * d;
+                    sr += rv * rv;
+                    st += xv * xv;
+                    sd += rv * xv;
+                    ma = std::max(ma, ad);
+                    mr = std::max(mr, ad / std::max(std::fabs(rv), 1e-6));
+                    // NaN fails every comparison: count it here, not in bin 0
+                    bool bad = !(ad <= std::numeric_limits<double>::max());
+                    nf += bad;
+                    float adf = float(ad);
+                    uint8_t b = 0;
+                    for (size_t t = 0; t < kErrorHistBins - 1; ++t) b += (adf >= thr[t]);
+                    bins[i] = bad ? uint8_t(kErrorHistBins - 1) : b;
+                }
+                for (size_t i = 0; i < len; ++i) ++hist[bins[i]];
+                sum_sq_err += se; sum_sq_ref += sr; sum_sq_test += st; sum_dot += sd;
+                max_abs = std::max(max_abs, ma);
+                max_rel = std::max(max_rel, mr);
+                nonfinite += nf;
+            }
+            count += n;
+        }
+
+        void merge(const Partial& o) {
+            sum_sq_err += o.sum_sq_err; sum_sq_ref += o.sum_sq_ref;
+            sum_sq_test += o.sum_sq_test; sum_dot += o.sum_dot;
+            max_abs = std::max(max_abs, o.max_abs);
+            max_rel = std::max(max_rel, o.max_rel);
+            count += o.count;
+            nonfinite += o.nonfinite;
+            for (size_t b = 0; b < kErrorHistBins; ++b) hist[b] += o.hist[b];
+        }
+    };
+
+    mutable std::mutex mtx_;
+    Partial total_;
 };
 
-// Computes MSE and max absolute error between two same-sized flat arrays.
+// Computes all error metrics between two same-sized flat buffers in one pass.
+inline ErrorStats measure_error(const float* ref, const float* test, size_t n,
+                                size_t num_threads = 4) {
+    ErrorAccumulator acc;
+    acc.update(ref, test, n, num_threads);
+    return acc.stats();
+}
+
 inline ErrorStats measure_error(const std::vector<float>& ref,
                                 const std::vector<float>& test) {
-    size_t N = ref.size();
-    double sum_sq = 0.0;
-    double max_err = 0.0;
-    for (size_t i = 0; i < N; ++i) {
-        double diff = double(test[i]) - double(ref[i]);
-        sum_sq += diff * diff;
-        max_err = std::max(max_err, std::abs(diff));
-    }
-    return { sum_sq / N, max_err };
+    if (ref.size() != test.size())
+        throw std::invalid_argument("measure_error: size mismatch");
+    return measure_error(ref.data(), test.data(), ref.size());
 }
@@ -1,14 +1,58 @@
 #include <pybind11/pybind11.h>
 #include <pybind11/stl.h>
+#include <pybind11/numpy.h>
+
+#include <chrono>
+#include <cstring>
+#include <memory>
+#include <optional>
+#include <tuple>
 
 #include "matrix.hpp"
 #include "lut_utils.hpp"
 #include "post_processing.hpp"
 #include "gemm_engine.hpp"
 #include "accuracy_utils.hpp"
+#include "dequant_gemm.hpp"
+#include "graph_runner.hpp"
+#include "trace.hpp"
+#include "shm_parallel.hpp"
+#include "huge_pages.hpp"
 
 namespace py = pybind11;
 
+// Python may drop an Engine while its workers still need the GIL to run
+// completion callbacks; release it while the pipeline drains.
+struct EngineDeleter {
+    void operator()(Engine* e) const {
+        py::gil_scoped_release release;
+        delete e;
+    }
+};
+
+// Holds a Python object that may be copied/destroyed on worker threads
+using SharedPyObject = std::shared_ptr<py::object>;
+inline SharedPyObject share_py(py::object o) {
+    return SharedPyObject(new py::object(std::move(o)), [](py::object* p) {
+        py::gil_scoped_acquire gil;
+        delete p;
+    });
+}
+
+inline py::dict stats_to_dict(const ErrorStats& s) {
+    py::dict d;
+    d["mse"]           = s.mse;
+    d["max_error"]     = s.max_error;
+    d["max_rel_error"] = s.max_rel_error;
+    d["cosine"]        = s.cosine;
+    d["snr_db"]        = s.snr_db;
+    d["count"]         = s.count;
+    d["nonfinite"]     = s.nonfinite;
+    std::vector<uint64_t> hist(s.histogram.begin(), s.histogram.end());
+    d["histogram"]     = hist;
+    return d;
+}
+
 PYBIND11_MODULE(mpgemm, m) {
     m.doc() = "mpGEMM Python bindings";
 
@@ -25,16 +69,10 @@ PYBIND11_MODULE(mpgemm, m) {
         [](const std::vector<float>& flatC,
            int M, int N,
            const std::vector<float>& bias) {
-            Matrix<float, RowMajor, PlainStorage<float>> C(M, N);
-            for (int i = 0; i < M; ++i)
-                for (int j = 0; j < N; ++j)
-                    C.set(i, j, flatC[i * N + j]);
-            auto R = add_bias(C, bias);
-            std::vector<float> out;
-            out.reserve(M * N);
-            for (int i = 0; i < M; ++i)
-                for (int j = 0; j < N; ++j)
-                    out.push_back(R.at(i, j));
+            if (M < 0 || N < 0 || flatC.size() != size_t(M) * N)
+                throw std::invalid_argument("buffer size does not match M × N");
+            std::vector<float> out(flatC.size());
+            assign_to(add_bias(MatView<float>(flatC.data(), M, N), bias), out.data());
             return out;
         },
         py::arg("C"), py::arg("M"), py::arg("N"), py::arg("bias"));
@@ -43,55 +81,473 @@ PYBIND11_MODULE(mpgemm, m) {
         [](const std::vector<float>& flatC,
            int M, int N,
            Activation act) {
-            Matrix<float, RowMajor, PlainStorage<float>> C(M, N);
-            for (int i = 0; i < M; ++i)
-                for (int j = 0; j < N; ++j)
-                    C.set(i, j, flatC[i * N + j]);
-            auto R = apply_activation(C, act);
-            std::vector<float> out;
-            out.reserve(M * N);
-            for (int i = 0; i < M; ++i)
-                for (int j = 0; j < N; ++j)
-                    out.push_back(R.at(i, j));
+            if (M < 0 || N < 0 || flatC.size() != size_t(M) * N)
+                throw std::invalid_argument("buffer size does not match M × N");
+            std::vector<float> out(flatC.size());
+            assign_to(apply_activation(MatView<float>(flatC.data(), M, N), act), out.data());
             return out;
         },
         py::arg("C"), py::arg("M"), py::arg("N"), py::arg("act"));
 
+    // --- NUMA / thread placement ---
+    m.def("set_thread_pinning", &set_thread_pinning,
+          "Pin GEMM worker threads to CPUs (node-major order)", py::arg("enable"));
+    m.def("numa_nodes", []() { return numa_topology().node_cpus; },
+          "CPU ids of each NUMA node");
+
+    // --- Huge-page backed allocation ---
+    py::enum_<HugePages>(m, "HugePages")
+        .value("Off",         HugePages::Off)
+        .value("Transparent", HugePages::Transparent)
+        .value("Explicit",    HugePages::Explicit);
+    m.def("set_huge_pages", &set_huge_pages,
+          "Back allocations of at least min_bytes (matrices, packed weights, lookup "
+          "tables, engine scratch) with 2 MiB pages: THP via madvise, or the hugetlbfs "
+          "pool with THP fallback; applies to allocations made afterwards. Blocks are "
+          "rounded up to whole 2 MiB pages, so min_bytes is at least 1 MiB",
+          py::arg("mode"), py::arg("min_bytes") = kHugePageSize);
+    m.def("huge_page_report",
+          []() {
+              HugePageReport r = huge_page_report();
+              py::dict d;
+              d["allocations"] = r.allocations;     d["requested_bytes"] = r.requested_bytes;
+              d["thp_bytes"] = r.thp_bytes;         d["hugetlb_bytes"] = r.hugetlb_bytes;
+              d["process_thp_bytes"] = r.process_thp_bytes;
+              d["huge_fraction"] = r.huge_fraction();
+              return d;
+          },
+          "Live huge-page allocations and how much of them the kernel backed with huge pages");
+
+    // --- Execution tracing (Chrome / Perfetto JSON) ---
+    m.def("set_tracing", &set_tracing,
+          "Record per-thread tile / LUT build / merge / engine spans; ring_capacity "
+          "(events per thread) applies to threads started afterwards",
+          py::arg("enable"), py::arg("ring_capacity") = 0);
+    m.def("trace_json", &trace_json, "Buffered trace events as Chrome trace JSON");
+    m.def("write_trace", &write_trace, "Write the trace JSON to a file", py::arg("path"));
+    m.def("clear_trace", &clear_trace, "Drop all buffered trace events");
+
+    // --- Registered weights ---
+    py::class_<WeightHandle>(m, "WeightHandle")
+        .def_property_readonly("rows", &WeightHandle::rows)
+        .def_property_readonly("cols", &WeightHandle::cols)
+        .def_property_readonly("size_bytes", &WeightHandle::bytes);
+
+    // --- Async handle ---
+    py::class_<Engine::MatmulFuture>(m, "MatmulFuture")
+        .def("result",
+            [](const Engine::MatmulFuture& f) {
+                py::gil_scoped_release release;
+                return f.get();
+            },
+            "Block until the GEMM finishes and return its output (re-raises errors)")
+        .def("wait",
+            [](const Engine::MatmulFuture& f, double timeout) {
+                py::gil_scoped_release release;
+                if (timeout < 0) { f.wait(); return true; }
+                return f.wait_for(std::chrono::duration<double>(timeout))
+                       == std::future_status::ready;
+            },
+            py::arg("timeout") = -1.0)
+        .def("done", [](const Engine::MatmulFuture& f) {
+                return f.wait_for(std::chrono::seconds(0)) == std::future_status::ready;
+            });
+
     // --- Engine class ---
-    py::class_<Engine>(m, "Engine")
+    // Engine methods are thread-safe (see gemm_engine.hpp); compute
+    // calls release the GIL so Python threads can share one engine.
+    using release_gil = py::call_guard<py::gil_scoped_release>;
+    py::class_<Engine, std::unique_ptr<Engine, EngineDeleter>>(m, "Engine")
         .def(py::init<const std::string&>(), py::arg("backend"))
         .def("generate_lut", &Engine::generate_lut,
-             "Generate LUT for INT4 backend", py::arg("bit_width"))
-        .def("matmul", &Engine::matmul,
-             "Perform GEMM with chosen backend",
+             "Configure the LUT backend for bit_width-bit (1-4) two's-complement weights",
+             py::arg("bit_width"))
+        .def("matmul",
+             py::overload_cast<const std::vector<uint8_t>&, const std::vector<float>&,
+                               int, int, int, bool, bool>(&Engine::matmul, py::const_),
+             "Perform GEMM with chosen backend; trans_w: weights stored K × M, "
+             "trans_a: activations stored N × K",
              py::arg("weights"), py::arg("activations"),
-             py::arg("M"), py::arg("K"), py::arg("N"))
+             py::arg("M"), py::arg("K"), py::arg("N"),
+             py::arg("trans_w") = false, py::arg("trans_a") = false, release_gil())
+        .def("matmul",
+            [](const Engine& e, const WeightHandle& W, const std::vector<float>& A,
+               int N, bool trans_a) {
+                py::gil_scoped_release release;
+                return e.matmul(W, A, N, trans_a);
+            },
+            "GEMM with weights packed earlier by register_weights",
+            py::arg("weights"), py::arg("activations"), py::arg("N"),
+            py::arg("trans_a") = false)
+        .def("register_weights", &Engine::register_weights,
+             "Pack M × K weights once for this engine; pass the handle to matmul",
+             py::arg("weights"), py::arg("M"), py::arg("K"), py::arg("trans_w") = false,
+             release_gil())
+        .def("set_weight_cache", &Engine::set_weight_cache,
+             "Cache packed weights by content, LRU within budget_bytes (0 disables)",
+             py::arg("budget_bytes"))
+        .def("weight_cache_stats",
+            [](const Engine& e) {
+                WeightCacheStats s = e.weight_cache_stats();
+                py::dict d;
+                d["hits"] = s.hits;           d["misses"] = s.misses;
+                d["evictions"] = s.evictions; d["entries"] = s.entries;
+                d["bytes"] = s.bytes;         d["budget_bytes"] = s.budget_bytes;
+                return d;
+            },
+            "Weight cache counters and occupancy")
+        .def("clear_weight_cache", &Engine::clear_weight_cache)
+        .def("matmul_multi", &Engine::matmul_multi,
+             "Multiply several weight matrices (weights[i]: Ms[i] × K) by one shared "
+             "activation; the LUT backend builds its tables once for all of them",
+             py::arg("weights"), py::arg("Ms"), py::arg("activations"),
+             py::arg("K"), py::arg("N"),
+             py::arg("trans_w") = false, py::arg("trans_a") = false, release_gil())
+        .def("matmul_fp16",
+            [](const Engine& e, const std::vector<uint8_t>& W, py::array A,
+               int M, int K, int N, bool out_fp16, bool trans_w, bool trans_a) -> py::array {
+                if (A.dtype().kind() != 'f' || A.itemsize() != 2)
+                    throw std::invalid_argument("activations must be a float16 array");
+                auto Ac = py::array::ensure(A, py::array::c_style);
+                std::vector<fp16_t> Ah(size_t(Ac.size()));
+                std::memcpy(Ah.data(), Ac.data(), Ah.size() * sizeof(fp16_t));
+                if (out_fp16) {
+                    std::vector<fp16_t> C;
+                    {
+                        py::gil_scoped_release release;
+                        C = e.matmul_fp16(W, Ah, M, K, N, trans_w, trans_a);
+                    }
+                    return py::array(py::dtype("float16"), {py::ssize_t(C.size())},
+                                     {py::ssize_t(sizeof(fp16_t))}, C.data());
+                }
+                std::vector<float> C;
+                {
+                    py::gil_scoped_release release;
+                    C = e.matmul(W, Ah, M, K, N, trans_w, trans_a);
+                }
+                return py::array_t<float>(py::ssize_t(C.size()), C.data());
+            },
+            "GEMM with numpy.float16 activations; returns float16 (or float32 "
+            "when out_fp16=False) as a flat numpy array",
+            py::arg("weights"), py::arg("activations"),
+            py::arg("M"), py::arg("K"), py::arg("N"),
+            py::arg("out_fp16") = true,
+            py::arg("trans_w") = false, py::arg("trans_a") = false)
+        .def("submit",
+            [](Engine& e, std::vector<uint8_t> W, std::vector<float> A,
+               int M, int K, int N, py::object callback) {
+                Engine::MatmulCallback cb;
+                if (!callback.is_none()) {
+                    auto fn = share_py(std::move(callback));
+                    cb = [fn](Engine::MatmulFuture f) {
+                        py::gil_scoped_acquire gil;
+                        try { (*fn)(f); }
+                        catch (py::error_already_set& err) { err.discard_as_unraisable(__func__); }
+                    };
+                }
+                return e.submit(std::move(W), std::move(A), M, K, N, std::move(cb));
+            },
+            "Queue a GEMM on the engine's worker pipeline; returns a MatmulFuture. "
+            "`callback(future)` runs on a worker thread when it completes.",
+            py::arg("weights"), py::arg("activations"),
+            py::arg("M"), py::arg("K"), py::arg("N"),
+            py::arg("callback") = py::none())
+        .def("submit_async",
+            [](Engine& e, std::vector<uint8_t> W, std::vector<float> A,
+               int M, int K, int N) {
+                py::object loop = py::module_::import("asyncio").attr("get_running_loop")();
+                py::object afut = loop.attr("create_future")();
+                auto loop_ref = share_py(loop);
+                auto fut_ref  = share_py(afut);
+                e.submit(std::move(W), std::move(A), M, K, N,
+                    [loop_ref, fut_ref](Engine::MatmulFuture f) {
+                        py::gil_scoped_acquire gil;
+                        py::object target = *fut_ref;
+                        py::object value;
+                        bool ok = true;
+                        try {
+                            value = py::cast(f.get());
+                        } catch (const std::exception& ex) {
+                            ok = false;
+                            value = py::module_::import("builtins")
+                                        .attr("RuntimeError")(ex.what());
+                        }
+                        // resolve on the loop thread; skip if already cancelled
+                        py::cpp_function resolve([target, value, ok]() {
+                            if (target.attr("done")().cast<bool>()) return;
+                            target.attr(ok ? "set_result" : "set_exception")(value);
+                        });
+                        try {
+                            loop_ref->attr("call_soon_threadsafe")(resolve);
+                        } catch (py::error_already_set& err) {   // loop already closed
+                            err.discard_as_unraisable(__func__);
+                        }
+                    });
+                return afut;
+            },
+            "Awaitable GEMM: returns an asyncio future bound to the running loop",
+            py::arg("weights"), py::arg("activations"),
+            py::arg("M"), py::arg("K"), py::arg("N"))
+        .def("benchmark",
+            [](const Engine& e, std::vector<std::string> methods, int num_runs,
+               std::vector<std::tuple<int,int,int>> shapes,
+               std::optional<std::vector<uint8_t>> weights,
+               std::optional<std::vector<float>> activations, int warmup) {
+                std::vector<BenchmarkResult> res;
+                {
+                    py::gil_scoped_release release;
+                    if (weights || activations) {
+                        if (!weights || !activations || shapes.size() != 1)
+                            throw std::invalid_argument(
+                                "weights and activations need each other and exactly one (M, K, N) shape");
+                        auto [M, K, N] = shapes[0];
+                        res = e.benchmark(methods, num_runs, *weights, *activations, M, K, N, warmup);
+                    } else {
+                        std::vector<BenchmarkShape> sh;
+                        for (auto [M, K, N] : shapes) sh.push_back({M, K, N});
+                        if (sh.empty()) sh.push_back({});
+                        res = e.benchmark(methods, num_runs, sh, warmup);
+                    }
+                }
+                py::list out;
+                for (const BenchmarkResult& r : res) {
+                    py::dict d;
+                    d["method"]    = r.method;
+                    d["M"] = r.M; d["K"] = r.K; d["N"] = r.N;
+                    d["runs"]      = r.runs;
+                    d["min_ms"]    = r.min_ms;
+                    d["median_ms"] = r.median_ms;
+                    d["p95_ms"]    = r.p95_ms;
+                    d["mean_ms"]   = r.mean_ms;
+                    d["gflops"]    = r.gflops;
+                    d["error"]     = stats_to_dict(r.error);
+                    out.append(d);
+                }
+                return out;
+            },
+            "Warm in-process timing of each method (default: this engine's backend) "
+            "on (M, K, N) shapes; returns one dict per method and shape with "
+            "min/median/p95 ms, GFLOP/s and error vs an fp64 reference",
+            py::arg("methods") = std::vector<std::string>{}, py::arg("num_runs") = 10,
+            py::arg("shapes") = std::vector<std::tuple<int,int,int>>{{256, 256, 256}},
+            py::arg("weights") = py::none(), py::arg("activations") = py::none(),
+            py::arg("warmup") = 1)
+        .def("matmul_stream",
+            [](const Engine& e, const MappedWeights& W, const std::vector<float>& A,
+               int N, size_t resident_bytes) {
+                py::gil_scoped_release release;
+                return e.matmul_stream(W, A, N, resident_bytes);
+            },
+            "LUT GEMM with weights streamed from a MappedWeights file, keeping "
+            "about resident_bytes of them in memory",
+            py::arg("weights"), py::arg("activations"), py::arg("N"),
+            py::arg("resident_bytes") = size_t(64) << 20)
+        .def("set_numa", &Engine::set_numa,
+             "Place LUT weights in node-local slices and pin each node's workers; "
+             "turns the weight cache on (256 MiB) if it is off",
+             py::arg("enable"))
+        .def("pending", &Engine::pending,
+             "Number of submitted calls not yet completed")
         .def("add_bias", &Engine::add_bias,
              "Add bias vector to GEMM output",
-             py::arg("C"), py::arg("M"), py::arg("N"), py::arg("bias"))
+             py::arg("C"), py::arg("M"), py::arg("N"), py::arg("bias"), release_gil())
         .def("apply_activation", &Engine::apply_activation,
              "Apply activation to GEMM output",
-             py::arg("C"), py::arg("M"), py::arg("N"), py::arg("act"));
-    
+             py::arg("C"), py::arg("M"), py::arg("N"), py::arg("act"), release_gil());
+
+    // --- Out-of-core weights ---
+    m.def("write_weight_file",
+        [](const std::string& path, const std::vector<uint8_t>& W, size_t M, size_t K) {
+            if (W.size() != M * K)
+                throw std::invalid_argument("weights size does not match M × K");
+            write_weight_file(path, W.data(), M, K);
+        },
+        "Write M × K int4 weights (one per element) as a streamable weight file",
+        py::arg("path"), py::arg("weights"), py::arg("M"), py::arg("K"));
+    py::class_<MappedWeights>(m, "MappedWeights")
+        .def(py::init<const std::string&>(), py::arg("path"),
+             "Memory-map a weight file written by write_weight_file")
+        .def_property_readonly("rows", &MappedWeights::rows)
+        .def_property_readonly("cols", &MappedWeights::cols);
+
+    // --- Multi-process tensor parallelism ---
+    py::enum_<ShardMode>(m, "ShardMode")
+        .value("Rows", ShardMode::Rows)
+        .value("K",    ShardMode::K);
+    py::class_<ShmTensorParallel>(m, "ShmTensorParallel")
+        .def(py::init<const std::string&, int, int, std::vector<uint8_t>, int, int,
+                      ShardMode, const std::string&, int, int>(),
+             "Attach this process as `rank` of a shared-memory tensor-parallel group; "
+             "weights is this rank's shard (see shard_range)",
+             py::arg("name"), py::arg("world"), py::arg("rank"), py::arg("weights"),
+             py::arg("M"), py::arg("K"), py::arg("mode") = ShardMode::Rows,
+             py::arg("backend") = "lut", py::arg("max_n") = 256,
+             py::arg("timeout_ms") = 30000,
+             py::call_guard<py::gil_scoped_release>())
+        .def_static("shard_range", &ShmTensorParallel::shard_range,
+             "[begin, end) of extent owned by rank",
+             py::arg("extent"), py::arg("world"), py::arg("rank"))
+        .def("matmul",
+            [](ShmTensorParallel& tp, const std::vector<float>& A, int N) {
+                py::gil_scoped_release release;
+                return tp.matmul(A, N);
+            },
+            "Rank 0: full C = W · A computed by all ranks",
+            py::arg("A"), py::arg("N"))
+        .def("serve", &ShmTensorParallel::serve,
+             "Ranks > 0: compute shards until rank 0 shuts the group down",
+             py::call_guard<py::gil_scoped_release>())
+        .def_property_readonly("world", &ShmTensorParallel::world)
+        .def_property_readonly("rank", &ShmTensorParallel::rank);
+
+    // --- Prepared dequantized weights ---
+    py::class_<DequantWeights>(m, "DequantWeights")
+        .def(py::init([](const std::vector<uint8_t>& W,
+                         const std::vector<float>& scales,
+                         int M, int K, bool int8, bool trans_w) {
+                if (W.size() != size_t(M) * K)
+                    throw std::invalid_argument("weights size does not match M × K");
+                if (!scales.empty() && scales.size() != size_t(M))
+                    throw std::invalid_argument("scales must have one entry per row");
+                return new DequantWeights(W.data(),
+                                          scales.empty() ? nullptr : scales.data(),
+                                          M, K, int8, trans_w);
+            }),
+            "Dequantize int4 weights once with per-row scales "
+            "(trans_w: weights stored K × M)",
+            py::arg("weights"), py::arg("scales") = std::vector<float>{},
+            py::arg("M"), py::arg("K"), py::arg("int8") = false,
+            py::arg("trans_w") = false)
+        .def("matmul",
+            [](const DequantWeights& Wd, const std::vector<float>& A, int N, bool trans_a) {
+                return Wd.matmul(A, N, trans_a);
+            },
+            "Multiply the prepared weights by a K × N (trans_a: N × K) activation matrix",
+            py::arg("activations"), py::arg("N"), py::arg("trans_a") = false)
+        .def_property_readonly("rows", &DequantWeights::rows)
+        .def_property_readonly("cols", &DequantWeights::cols)
+        .def_property_readonly("size_bytes", &DequantWeights::size_bytes);
+
+    // --- Codebook (NF4 / fitted) weights ---
+    py::class_<CodebookWeights>(m, "CodebookWeights")
+        .def(py::init([](const std::vector<float>& W, int M, int K,
+                         size_t group_rows, int iters) {
+                if (W.size() != size_t(M) * K)
+                    throw std::invalid_argument("weights size does not match M × K");
+                return new CodebookWeights(quantize_codebook(W.data(), M, K, group_rows, iters));
+            }),
+            "Quantize float weights to 4-bit codes with one 16-value codebook per "
+            "group of rows (NF4 start, `iters` k-means refinements; 0 = plain NF4). "
+            "matmul builds one table per group and k, so small groups cost speed",
+            py::arg("weights"), py::arg("M"), py::arg("K"),
+            py::arg("group_rows") = kCodebookGroupRows, py::arg("iters") = 10)
+        .def("matmul",
+            [](const CodebookWeights& W, const std::vector<float>& A, int N) {
+                if (A.size() != W.cols * size_t(N))
+                    throw std::invalid_argument("activations size does not match K × N");
+                std::vector<float> C(W.rows * size_t(N));
+                py::gil_scoped_release release;
+                matmul_lut_codebook(W, A.data(), C.data(), N);
+                return C;
+            },
+            "LUT GEMM with the codebook weights and a K × N activation matrix",
+            py::arg("activations"), py::arg("N"))
+        .def("dequantize", &dequantize_codebook)
+        .def_readonly("rows", &CodebookWeights::rows)
+        .def_readonly("cols", &CodebookWeights::cols)
+        .def_readonly("group_rows", &CodebookWeights::group_rows)
+        .def_readonly("codes", &CodebookWeights::codes)
+        .def_readonly("codebooks", &CodebookWeights::codebooks);
+
+    // --- Multi-layer graph ---
+    py::class_<LinearGraph>(m, "LinearGraph")
+        .def(py::init<const std::string&, size_t>(),
+             py::arg("backend") = "w4a8", py::arg("num_threads") = 4)
+        .def("add_linear", &LinearGraph::add_linear,
+             "Append act(W · x + b); W is out_features × in_features int4",
+             py::arg("weights"), py::arg("out_features"), py::arg("in_features"),
+             py::arg("scales") = std::vector<float>{},
+             py::arg("bias") = std::vector<float>{},
+             py::arg("act") = Activation::Linear)
+        .def("reserve", &LinearGraph::reserve,
+             "Preallocate activation buffers for up to max_tokens tokens",
+             py::arg("max_tokens"))
+        .def("run",
+            [](LinearGraph& g, const std::vector<float>& X, size_t N) {
+                py::gil_scoped_release release;
+                return g.run(X, N);
+            },
+            "Run all layers on an in_features × N input",
+            py::arg("x"), py::arg("N"))
+        .def("layer_times_ms", &LinearGraph::layer_times_ms,
+             "Per-layer wall time of the last run (ms)")
+        .def_property_readonly("num_layers", &LinearGraph::num_layers);
+
     // --- Error measurement ---
+    // float32 C-contiguous NumPy arrays are read in place; anything else
+    // (lists, other dtypes) is converted once by pybind11.
+    using FloatArray = py::array_t<float, py::array::c_style | py::array::forcecast>;
+
     py::class_<ErrorStats>(m, "ErrorStats")
-        .def_readonly("mse",       &ErrorStats::mse)
-        .def_readonly("max_error", &ErrorStats::max_error);
+        .def_readonly("mse",           &ErrorStats::mse)
+        .def_readonly("max_error",     &ErrorStats::max_error)
+        .def_readonly("max_rel_error", &ErrorStats::max_rel_error)
+        .def_readonly("cosine",        &ErrorStats::cosine)
+        .def_readonly("snr_db",        &ErrorStats::snr_db)
+        .def_readonly("count",         &ErrorStats::count)
+        .def_readonly("nonfinite",     &ErrorStats::nonfinite)
+        .def_property_readonly("histogram", [](const ErrorStats& s) {
+            return std::vector<uint64_t>(s.histogram.begin(), s.histogram.end());
+        });
+
+    py::class_<ErrorAccumulator>(m, "ErrorAccumulator")
+        .def(py::init<>())
+        .def("update",
+            [](ErrorAccumulator& acc, FloatArray ref, FloatArray test, size_t num_threads) {
+                if (ref.size() != test.size())
+                    throw std::invalid_argument("reference and test sizes differ");
+                const float* r = ref.data();
+                const float* t = test.data();
+                size_t n = size_t(ref.size());
+                py::gil_scoped_release release;
+                acc.update(r, t, n, num_threads);
+            },
+            "Accumulate one tile/chunk of outputs",
+            py::arg("reference"), py::arg("test"), py::arg("num_threads") = 4)
+        .def("reset", &ErrorAccumulator::reset)
+        .def("stats", [](const ErrorAccumulator& acc) {
+                return stats_to_dict(acc.stats());
+            });
+
     m.def("measure_error",
-        [](const std::vector<float>& ref,
-            const std::vector<float>& test) {
-            auto s = measure_error(ref, test);
-            py::dict d;
-            d["mse"]       = s.mse;
-            d["max_error"] = s.max_error;
-            return d;
+        [](FloatArray ref, FloatArray test, size_t num_threads) {
+            if (ref.size() != test.size())
+                throw std::invalid_argument("reference and test sizes differ");
+            const float* r = ref.data();
+            const float* t = test.data();
+            size_t n = size_t(ref.size());
+            ErrorStats s;
+            {
+                py::gil_scoped_release release;
+                s = measure_error(r, t, n, num_threads);
+            }
+            return stats_to_dict(s);
         },
         py::arg("reference"),
         py::arg("test"),
+        py::arg("num_threads") = 4,
         R"(
-    Compute error statistics between two flat float lists:
+    Compute error statistics between two equally sized float buffers
+    (NumPy arrays are used in place) in a single multithreaded pass:
     - mse: mean squared error
     - max_error: maximum absolute error
-    Returns a dict: {\"mse\": ..., \"max_error\": ...}
+    - max_rel_error: maximum |test - ref| / max(|ref|, 1e-6)
+    - cosine: cosine similarity
+    - snr_db: signal-to-noise ratio in dB
+    - histogram: absolute-error counts per decade
+      ([0,1e-9), [1e-9,1e-8), ..., [1,10), [10,inf) or non-finite)
+    - nonfinite: elements whose error is NaN or inf; when nonzero,
+      max_error and max_rel_error are inf and snr_db is -inf
+    Returns a dict with these keys plus "count".
     )");
 }
\ No newline at end of file
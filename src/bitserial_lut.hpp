@@ -0,0 +1,251 @@
+#pragma once
+#include <vector>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <algorithm>
+#include <stdexcept>
+
+#include "matrix.hpp"
+#include "layout_policies.hpp"
+#include "huge_pages.hpp"
+#include "lut_kernels.hpp"
+#include "tile_scheduler.hpp"
+
+// =============================================================
+//  Bit-serial LUT GEMM (T-MAC style), weights of 1–4 bits
+//  A b-bit two's-complement weight is a signed sum of bit planes
+//    w = Σ_{p < b-1} 2^p · w_p  −  2^(b-1) · w_(b-1),   w_p ∈ {0, 1}
+//  so a row's dot product with activations a is, per group of
+//  g = 4 consecutive k,  Σ_p ±2^p · T[pattern_p], where
+//    T[s] = Σ_{t : bit t of s set} a_t          (16 entries)
+//  and pattern_p holds bit p of the group's four weights.
+//  Each group's table is built once per output column and read by
+//  every weight row and every plane: all bit widths share the same
+//  tables, table size does not depend on b, and the lookups (and
+//  the weight bytes streamed) scale linearly with b.
+// =============================================================
+
+constexpr size_t kBitSerialGroup = 4;
+
+// b-bit weights split into bit planes. Per row, byte (pair, p)
+// holds plane p of groups 2·pair (low nibble) and 2·pair + 1 (high
+// nibble), so a row is bits · ⌈groups / 2⌉ bytes (b · K / 8).
+struct BitPlaneWeights {
+    size_t rows = 0, cols = 0;
+    unsigned bits = 4;
+    size_t groups = 0;              // ⌈cols / 4⌉, zero-padded
+    huge_vector<uint8_t> planes;
+
+    size_t row_bytes() const noexcept { return bits * ((groups + 1) / 2); }
+    const uint8_t* row(size_t r) const noexcept { return planes.data() + r * row_bytes(); }
+    size_t size_bytes() const noexcept { return planes.size(); }
+
+    // 4-bit pattern of plane p for group g of row r
+    unsigned pattern(size_t r, size_t g, unsigned p) const noexcept {
+        return (row(r)[(g / 2) * bits + p] >> ((g & 1) * 4)) & 0x0F;
+    }
+
+    // Signed weight value at (r, k), for verification
+    int value(size_t r, size_t k) const noexcept {
+        int v = 0;
+        for (unsigned p = 0; p < bits; ++p)
+            if ((pattern(r, k / kBitSerialGroup, p) >> (k % kBitSerialGroup)) & 1)
+                v += p + 1 == bits ? -(1 << p) : (1 << p);
+        return v;
+    }
+};
+
+// W(r, k) = W[ws(r, k)]: two's-complement codes, low `bits` bits used
+// (for bits = 4 the same nibbles the other LUT kernels read)
+inline BitPlaneWeights pack_bit_planes(const uint8_t* W, size_t M, size_t K,
+                                       unsigned bits, Strides ws)
+{
+    if (bits < 1 || bits > 4)
+        throw std::invalid_argument("bit-serial LUT supports 1- to 4-bit weights");
+    BitPlaneWeights P;
+    P.rows = M; P.cols = K; P.bits = bits;
+    P.groups = (K + kBitSerialGroup - 1) / kBitSerialGroup;
+    P.planes.assign(M * P.row_bytes(), 0);
+    for (size_t r = 0; r < M; ++r) {
+        uint8_t* out = P.planes.data() + r * P.row_bytes();
+        for (size_t k = 0; k < K; ++k) {
+            const unsigned q = W[ws(r, k)];
+            const size_t g = k / kBitSerialGroup;
+            const unsigned bit = unsigned(k % kBitSerialGroup) + (g & 1) * 4;
+            for (unsigned p = 0; p < bits; ++p)
+                out[(g / 2) * bits + p] |= uint8_t(((q >> p) & 1u) << bit);
+        }
+    }
+    return P;
+}
+
+inline BitPlaneWeights pack_bit_planes(const uint8_t* W, size_t M, size_t K,
+                                       unsigned bits, bool trans_w = false)
+{
+    return pack_bit_planes(W, M, K, bits, Transpose{trans_w, false}.w_strides(M, K));
+}
+
+namespace detail {
+
+using BitSerialLanes = LutLanes<int32_t>;
+
+// Group tables for groups [g0, g0 + ng) and columns [0, cols):
+// T + (g · 16 + s) · ld holds T_g[s] for every column
+template <typename A>
+void bitserial_build_tables(const A* A_mat, Strides as, size_t K, size_t g0, size_t ng,
+                            size_t cols, int32_t* T, size_t ld)
+{
+    for (size_t g = 0; g < ng; ++g) {
+        int32_t* Tg = T + g * 16 * ld;
+        std::fill(Tg, Tg + ld, 0);                      // s = 0
+        for (size_t t = 0; t < kBitSerialGroup; ++t) {
+            const size_t k = (g0 + g) * kBitSerialGroup + t;
+            const size_t half = size_t(1) << t;        // s in [half, 2·half) = s - half plus a_t
+            for (size_t s = 0; s < half; ++s) {
+                const int32_t* lo = Tg + s * ld;
+                int32_t* hi = Tg + (s + half) * ld;
+                if (k < K)
+                    for (size_t j = 0; j < cols; ++j) hi[j] = lo[j] + int32_t(A_mat[as(k, j)]);
+                else
+                    std::copy(lo, lo + cols, hi);
+            }
+        }
+    }
+}
+
+// C(MR × 16) += Σ_g Σ_p ±2^p · T_g[pattern] for groups [g0, g0 + ng):
+// planes combined by Horner's rule (top plane negative), accumulators
+// in registers across the group block
+template <int MR, int BITS>
+[[gnu::always_inline]] inline void
+bitserial_micro(const BitPlaneWeights& W, size_t r0, size_t g0, size_t ng,
+                const int32_t* T, size_t ld, size_t j0, int32_t* C, size_t ldc)
+{
+    using V = BitSerialLanes::type;
+    constexpr int L = BitSerialLanes::kWidth;
+    const size_t rb = W.row_bytes();
+    const uint8_t* w0 = W.row(r0);
+    V acc[MR][2] = {};
+    auto load = [](const int32_t* p) { V x; std::memcpy(&x, p, sizeof(V)); return x; };
+    for (size_t g = 0; g < ng; ++g) {
+        const size_t gg = g0 + g;
+        const int32_t* Tg = T + g * 16 * ld + j0;
+        const unsigned sh = unsigned(gg & 1) * 4;
+        const size_t off = (gg / 2) * BITS;
+#pragma GCC unroll 8
+        for (int r = 0; r < MR; ++r) {
+            const uint8_t* wp = w0 + size_t(r) * rb + off;
+            const int32_t* row = Tg + size_t((wp[BITS - 1] >> sh) & 0x0F) * ld;
+            V v0 = -load(row), v1 = -load(row + L);
+#pragma GCC unroll 4
+            for (int p = BITS - 2; p >= 0; --p) {
+                row = Tg + size_t((wp[p] >> sh) & 0x0F) * ld;
+                v0 = v0 + v0 + load(row);
+                v1 = v1 + v1 + load(row + L);
+            }
+            acc[r][0] += v0;
+            acc[r][1] += v1;
+        }
+    }
+#pragma GCC unroll 8
+    for (int r = 0; r < MR; ++r) {
+        int32_t* c = C + size_t(r) * ldc;
+        const V c0 = load(c) + acc[r][0], c1 = load(c + L) + acc[r][1];
+        std::memcpy(c, &c0, sizeof(V));
+        std::memcpy(c + L, &c1, sizeof(V));
+    }
+}
+
+// Any rows / columns (tile edges)
+inline void bitserial_edge(const BitPlaneWeights& W, size_t r0, size_t rows,
+                           size_t g0, size_t ng, const int32_t* T, size_t ld,
+                           size_t j0, size_t cols, int32_t* C, size_t ldc)
+{
+    const unsigned b = W.bits;
+    for (size_t r = 0; r < rows; ++r) {
+        int32_t* c = C + r * ldc;
+        for (size_t g = 0; g < ng; ++g) {
+            const int32_t* Tg = T + g * 16 * ld + j0;
+            const int32_t* top = Tg + size_t(W.pattern(r0 + r, g0 + g, b - 1)) * ld;
+            for (size_t j = 0; j < cols; ++j) {
+                int32_t v = -top[j];
+                for (int p = int(b) - 2; p >= 0; --p)
+                    v = 2 * v + Tg[size_t(W.pattern(r0 + r, g0 + g, unsigned(p))) * ld + j];
+                c[j] += v;
+            }
+        }
+    }
+}
+
+template <int BITS>
+void bitserial_block(const BitPlaneWeights& W, size_t r0, size_t rows, size_t g0, size_t ng,
+                     const int32_t* T, size_t ld, size_t cols, int32_t* C, size_t ldc)
+{
+    constexpr int MR = 4, NR = 2 * BitSerialLanes::kWidth;
+    const size_t full_c = cols / NR * NR;
+    size_t r = 0;
+    for (; r + MR <= rows; r += MR)
+        for (size_t j = 0; j < full_c; j += NR)
+            bitserial_micro<MR, BITS>(W, r0 + r, g0, ng, T, ld, j, C + r * ldc + j, ldc);
+    for (; r < rows; ++r)
+        for (size_t j = 0; j < full_c; j += NR)
+            bitserial_micro<1, BITS>(W, r0 + r, g0, ng, T, ld, j, C + r * ldc + j, ldc);
+    if (full_c < cols)
+        bitserial_edge(W, r0, rows, g0, ng, T, ld, full_c, cols - full_c, C + full_c, ldc);
+}
+
+// Groups per table block: keeps the block's tables within ~16 KiB (L1)
+inline size_t bitserial_groups_per_block(size_t ld) {
+    return std::max<size_t>(1, (size_t(16) << 10) / (16 * ld * sizeof(int32_t)));
+}
+
+} // namespace detail
+
+// =============================================================
+//  C (M × N, int32) = W (BitPlaneWeights, M × K) · A (K × N signed
+//  integers, N × K with trans_a). Tiles are scheduled as in
+//  matmul_lut_fast; each worker owns one block of group tables,
+//  built per (tile, group block) and streamed against all the
+//  tile's rows and planes.
+// =============================================================
+
+template <typename A, typename AAlloc>
+auto matmul_lut_bitserial(const BitPlaneWeights& W,
+                          const std::vector<A, AAlloc>& A_mat,
+                          size_t N,
+                          size_t num_threads = 4,
+                          bool trans_a = false)
+{
+    const size_t M = W.rows, K = W.cols;
+    if (A_mat.size() != K * N)
+        throw std::invalid_argument("activations size does not match K × N");
+    Matrix<int32_t, RowMajor, PlainStorage<int32_t>> C(M, N);
+    if (M == 0 || N == 0) return C;   // no tiles; table width would be 0
+    int32_t* Cd = C.data();
+    const Strides as = Transpose{false, trans_a}.a_strides(K, N);
+
+    const TileShape shape = choose_tile_shape(M, N, num_threads, {128, 64}, 32);
+    const size_t ld = std::min(shape.nc, N);
+    const size_t gb = detail::bitserial_groups_per_block(ld);
+    auto block = W.bits == 1 ? &detail::bitserial_block<1>
+               : W.bits == 2 ? &detail::bitserial_block<2>
+               : W.bits == 3 ? &detail::bitserial_block<3>
+                             : &detail::bitserial_block<4>;
+
+    parallel_for_tiles(M, N, shape, num_threads,
+        [&](size_t) { return huge_vector<int32_t>(gb * 16 * ld); },
+        [&](const Tile& tile, huge_vector<int32_t>& T) {
+            for (size_t g0 = 0; g0 < W.groups; g0 += gb) {
+                const size_t ng = std::min(gb, W.groups - g0);
+                {
+                    TraceScope span("lut_build", "lut", "g0", int64_t(g0));
+                    detail::bitserial_build_tables(&A_mat[as(0, tile.n0)], as, K, g0, ng,
+                                                   tile.cols(), T.data(), ld);
+                }
+                block(W, tile.m0, tile.rows(), g0, ng, T.data(), ld, tile.cols(),
+                      Cd + tile.m0 * N + tile.n0, N);
+            }
+        });
+    return C;
+}
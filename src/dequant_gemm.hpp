@@ -0,0 +1,165 @@
+#pragma once
+#include <vector>
+#include <cstddef>
+#include <cstdint>
+#include <stdexcept>
+#include <utility>
+
+#include "matrix_ops.hpp"
+#include "quant_utils.hpp"
+
+// =============================================================
+//  Dequantize-then-GEMM weights — the reference baseline for LUT
+//  GEMM. int4 weights (two's-complement nibbles 0‥15) are mapped
+//  and scaled per output row *once*, then kept in kernel-ready form
+//  and reused by every matmul call:
+//  * MKL, float:  cblas_sgemm_pack'ed panel + cblas_sgemm_compute
+//  * MKL, int8:   int8 weights for cblas_gemm_s8u8s32
+//  * no MKL:      row-major float for matmul_f32_blocked, or the
+//                 W4A8 kernel for int8
+//  The int8 mode quantizes activations per token (column of A) and
+//  rescales by w_scale[i] · a_scale[j] in the epilogue.
+//  * W shape: M × K (K × M with trans_w, re-laid out once here)
+//  * A shape: K × N (N × K with trans_a, read in place per call)
+//  * C shape: M × N
+// =============================================================
+
+class DequantWeights {
+public:
+    DequantWeights(const uint8_t* W, const float* scales,
+                   size_t M, size_t K, bool int8 = false, bool trans_w = false)
+      : M_(M), K_(K), int8_(int8),
+        scales_(scales ? std::vector<float>(scales, scales + M)
+                       : std::vector<float>(M, 1.0f))
+    {
+        const Strides sw = Transpose{trans_w, false}.w_strides(M, K);
+        if (int8_) {
+#ifdef USE_MKL
+            wi8_.resize(M * K);
+            for (size_t i = 0; i < M; ++i)
+                for (size_t k = 0; k < K; ++k)
+                    wi8_[i * K + k] = detail::int4_to_int8(W[sw(i, k)]);
+#else
+            wq_.resize(M * K);
+            for (size_t i = 0; i < M; ++i)
+                for (size_t k = 0; k < K; ++k)
+                    wq_[i * K + k] = W[sw(i, k)];
+#endif
+            return;
+        }
+
+        huge_vector<float> wf(M * K);
+        for (size_t i = 0; i < M; ++i)
+            for (size_t k = 0; k < K; ++k)
+                wf[i * K + k] = float(detail::int4_to_int8(W[sw(i, k)])) * scales_[i];
+#ifdef USE_MKL
+        packed_ = cblas_sgemm_alloc(CblasAMatrix, M, 1, K);
+        if (!packed_) throw std::bad_alloc();
+        cblas_sgemm_pack(CblasRowMajor, CblasAMatrix, CblasNoTrans,
+                         M, 1, K, 1.0f, wf.data(), K, packed_);
+#else
+        wf_ = std::move(wf);
+#endif
+    }
+
+    DequantWeights(const DequantWeights&) = delete;
+    DequantWeights& operator=(const DequantWeights&) = delete;
+
+    DequantWeights(DequantWeights&& o) noexcept { swap(o); }
+    DequantWeights& operator=(DequantWeights&& o) noexcept { swap(o); return *this; }
+
+    ~DequantWeights() {
+#ifdef USE_MKL
+        if (packed_) cblas_sgemm_free(packed_);
+#endif
+    }
+
+    // C (M × N) = dequant(W) · A (K × N, or N × K with trans_a); C is overwritten
+    void matmul(const float* A, float* C, size_t N, size_t num_threads = 4,
+                bool trans_a = false) const {
+        const Transpose trans{false, trans_a};
+        if (int8_) {
+#ifdef USE_MKL
+            const Strides sa = trans.a_strides(K_, N);
+            std::vector<float> a_scales(N), inv(N);
+            compute_token_scales_int8(A, K_, N, a_scales.data(), trans_a);
+            for (size_t j = 0; j < N; ++j) inv[j] = 1.0f / a_scales[j];
+            // u8 activations with a +128 offset, cancelled through bo = -128
+            std::vector<uint8_t> au8(K_ * N);
+            for (size_t k = 0; k < K_; ++k)
+                for (size_t j = 0; j < N; ++j)
+                    au8[k * N + j] = uint8_t(int(quantize_int8(A[sa(k, j)], inv[j])) + 128);
+            std::vector<MKL_INT32> acc(M_ * N);
+            MKL_INT32 co = 0;
+            cblas_gemm_s8u8s32(CblasRowMajor, CblasNoTrans, CblasNoTrans, CblasFixOffset,
+                               M_, N, K_, 1.0f,
+                               wi8_.data(), K_, 0,
+                               au8.data(), N, -128,
+                               0.0f, acc.data(), N, &co);
+            for (size_t i = 0; i < M_; ++i)
+                for (size_t j = 0; j < N; ++j)
+                    C[i * N + j] = float(acc[i * N + j]) * scales_[i] * a_scales[j];
+#else
+            matmul_w4a8(wq_.data(), A, C, M_, K_, N, scales_.data(),
+                        W4A8Path::Auto, num_threads, trans);
+#endif
+            return;
+        }
+#ifdef USE_MKL
+        (void)num_threads;
+        cblas_sgemm_compute(CblasRowMajor, CblasPacked,
+                            trans_a ? CblasTrans : CblasNoTrans,
+                            M_, N, K_, packed_, K_, A, trans_a ? K_ : N, 0.0f, C, N);
+#else
+        matmul_f32_blocked(wf_.data(), A, C, M_, K_, N, num_threads, trans);
+#endif
+    }
+
+    std::vector<float> matmul(const std::vector<float>& A, size_t N,
+                              bool trans_a = false) const {
+        if (A.size() != K_ * N)
+            throw std::invalid_argument("activation size does not match K × N");
+        std::vector<float> C(M_ * N);
+        matmul(A.data(), C.data(), N, 4, trans_a);
+        return C;
+    }
+
+    size_t rows() const noexcept { return M_; }
+    size_t cols() const noexcept { return K_; }
+    bool int8_mode() const noexcept { return int8_; }
+    size_t size_bytes() const noexcept {
+        size_t bytes = scales_.size() * sizeof(float);
+#ifdef USE_MKL
+        bytes += int8_ ? wi8_.size() : M_ * K_ * sizeof(float);
+#else
+        bytes += int8_ ? wq_.size() : wf_.size() * sizeof(float);
+#endif
+        return bytes;
+    }
+
+private:
+    size_t M_ = 0, K_ = 0;
+    bool int8_ = false;
+    std::vector<float> scales_;
+#ifdef USE_MKL
+    float* packed_ = nullptr;
+    huge_vector<int8_t> wi8_;
+#else
+    huge_vector<float> wf_;
+    huge_vector<uint8_t> wq_;
+#endif
+
+    void swap(DequantWeights& o) noexcept {
+        std::swap(M_, o.M_);
+        std::swap(K_, o.K_);
+        std::swap(int8_, o.int8_);
+        std::swap(scales_, o.scales_);
+#ifdef USE_MKL
+        std::swap(packed_, o.packed_);
+        std::swap(wi8_, o.wi8_);
+#else
+        std::swap(wf_, o.wf_);
+        std::swap(wq_, o.wq_);
+#endif
+    }
+};
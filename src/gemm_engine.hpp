@@ -3,6 +3,14 @@
 #include <vector>
 #include <memory>
 #include <stdexcept>
+#include <functional>
+#include <future>
+#include <mutex>
+#include <atomic>
+#include <optional>
+#include <chrono>
+#include <random>
+#include <algorithm>
 
 #include "layout_policies.hpp"
 #include "storage_policies.hpp"
@@ -10,124 +18,438 @@
 #include "matrix_ops.hpp"
 #include "lut_utils.hpp"
 #include "post_processing.hpp"
+#include "dequant_gemm.hpp"
+#include "thread_pool.hpp"
+#include "weight_stream.hpp"
+#include "accuracy_utils.hpp"
+#include "weight_cache.hpp"
+#include "bitserial_lut.hpp"
 
 enum class Backend {
     Naive,
-    LUT
+    LUT,
+    W4A8,
+    Dequant
 #ifdef USE_MKL
   , MKL
 #endif
 };
 
+// One benchmarked (method, shape): latency over warm runs, throughput
+// at the median, and error against an fp64 reference GEMM
+struct BenchmarkResult {
+    std::string method;
+    int M = 0, K = 0, N = 0;
+    size_t runs = 0;
+    double min_ms = 0.0, median_ms = 0.0, p95_ms = 0.0, mean_ms = 0.0;
+    double gflops = 0.0;
+    ErrorStats error;
+};
+
+struct BenchmarkShape {
+    int M = 256, K = 256, N = 256;
+};
+
+// Kernel-ready weights: everything an Engine derives from W alone,
+// in the form its backend reads (shared by the weight cache and
+// register_weights handles)
+struct PackedWeights {
+    Backend backend;
+    bool numa = false;
+    int M = 0, K = 0;
+    int bits = 4;                                           // weight bit width
+    bool trans_w = false;                                   // as the kernel reads Wu
+    std::optional<Matrix<int,RowMajor,PlainStorage<int>>> Wi;   // naive
+    huge_vector<uint8_t> Wu;                                // w4a8
+    std::unique_ptr<BitPlaneWeights> Wb;                    // lut (bit-serial)
+    std::unique_ptr<NumaWeights> Wn;                        // lut + numa
+    std::unique_ptr<DequantWeights> Wd;                     // dequant / mkl
+    std::shared_ptr<const ProductLookupTable<uint8_t,int8_t,int32_t>> lut;   // lut + numa: the engine's table
+
+    // footprint charged against the cache budget
+    size_t bytes() const {
+        const size_t MK = size_t(M) * K;
+        return (Wi ? MK * sizeof(int) : 0) + Wu.size() + (Wb ? Wb->size_bytes() : 0)
+             + (Wn ? MK : 0) + (Wd ? Wd->size_bytes() : 0);
+    }
+};
+
+// Weights packed once by Engine::register_weights; valid for the
+// engine (backend and NUMA setting) that made it
+class WeightHandle {
+public:
+    WeightHandle() = default;
+    int rows() const { return w_ ? w_->M : 0; }
+    int cols() const { return w_ ? w_->K : 0; }
+    size_t bytes() const { return w_ ? w_->bytes() : 0; }
+    explicit operator bool() const { return bool(w_); }
+
+private:
+    friend class Engine;
+    explicit WeightHandle(std::shared_ptr<const PackedWeights> w) : w_(std::move(w)) {}
+    std::shared_ptr<const PackedWeights> w_;
+};
+
+// =============================================================
+//  Concurrency model
+//  One Engine may serve many threads at once: every const member
+//  (matmul, matmul_multi, matmul_stream, register_weights,
+//  benchmark, …) and submit are safe to call concurrently.
+//    * Per-call state — packed activations, output buffers, LUT
+//      tables (built per worker, see matmul_lut_fast) — lives in
+//      the call's PreparedCall or its workers' scratch.
+//    * Shared state is read-only during a call: the backend, the
+//      lookup-table configuration and the NUMA flag are read once
+//      per call (the table through a shared_ptr snapshot), and
+//      packed weights are immutable once built.
+//    * The weight cache and the async pipeline queues synchronize
+//      internally.
+//  Setup calls (generate_lut, set_numa, set_weight_cache) may also
+//  race with running calls; those calls finish with the settings
+//  they started with.
+// =============================================================
+
 class Engine {
 public:
     Engine(const std::string &backend_str)
-      : lut(nullptr)
+      : backend_name_(backend_str)
     {
         if      (backend_str == "naive")   backend = Backend::Naive;
         else if (backend_str == "lut")     backend = Backend::LUT;
+        else if (backend_str == "w4a8")    backend = Backend::W4A8;
+        else if (backend_str == "dequant") backend = Backend::Dequant;
 #ifdef USE_MKL
         else if (backend_str == "mkl")     backend = Backend::MKL;
 #endif
         else throw std::invalid_argument("Unknown backend: " + backend_str);
     }
 
+    // Weights are bit_width-bit two's-complement codes (1–4 bits);
+    // activations are rounded to int4. The LUT backend multiplies
+    // with the bit-serial kernel (matmul_lut_bitserial), whose
+    // tables do not depend on bit_width; NUMA placement,
+    // matmul_multi and matmul_stream use per-level tables of
+    // 2^bit_width rows, configured here once.
     void generate_lut(int bit_width) {
         if (backend != Backend::LUT)
             throw std::runtime_error("generate_lut only valid for LUT backend");
-        if(bit_width!=4)
-            throw std::invalid_argument("LUT currently only supports bit_width=4");
-        int range = 1 << bit_width;
-        lut = std::make_unique<ProductLookupTable<uint8_t,uint8_t,int32_t>>(range, range);
+        if (bit_width < 1 || bit_width > 4)
+            throw std::invalid_argument("LUT supports bit widths 1 to 4");
+        std::shared_ptr<const LutConfig> c = std::make_shared<const LutConfig>(bit_width);
+        std::atomic_store(&lut, std::move(c));
     }
 
+    // NUMA placement for the LUT backend: weights are split into
+    // node-local row slices and each node's workers are pinned to it.
+    // Slicing and placing W is a full pass over it, so enabling NUMA
+    // turns the weight cache on with kNumaCacheBudget bytes when it is
+    // off; set_weight_cache afterwards resizes or disables it, and
+    // register_weights avoids even the content lookup.
+    static constexpr size_t kNumaCacheBudget = size_t(256) << 20;
+    void set_numa(bool enable) {
+        if (numa.exchange(enable) != enable) weight_cache_.clear();   // packed forms differ
+        if (enable && backend == Backend::LUT) weight_cache_.set_budget_if_off(kNumaCacheBudget);
+    }
+    bool numa_enabled() const { return numa; }
+
+    const std::string& backend_name() const { return backend_name_; }
+
+    // trans_w: W is stored K × M; trans_a: A is stored N × K (token-major).
+    // Backends read these orders directly instead of transposing.
     std::vector<float> matmul(
         const std::vector<uint8_t>& Wflat,
         const std::vector<float>&   Aflat,
-        int M, int K, int N) const
+        int M, int K, int N,
+        bool trans_w = false, bool trans_a = false) const
     {
-        std::vector<float> out;
-        out.reserve(size_t(M) * N);
+        PreparedCall call = prepare_call(Wflat, Aflat, M, K, N, {trans_w, trans_a});
+        return run_call(call, Aflat);
+    }
 
-        switch (backend) {
-        case Backend::Naive: {
-            Matrix<int,RowMajor,PlainStorage<int>> Wi(M, K), Ai(K, N);
-            for (int i = 0; i < M; ++i)
-                for (int j = 0; j < K; ++j) {
-                    int val = Wflat[size_t(i)*K + j];
-                    Wi.set(i, j, val < 8 ? val : val - 16);  
-                }
-            for (int i = 0; i < K; ++i)
-                for (int j = 0; j < N; ++j)
-                    Ai.set(i, j, (int)std::lround(Aflat[size_t(i)*N + j]));
-            auto C = ::matmul(Wi, Ai);
-            for (int i = 0; i < M; ++i)
-                for (int j = 0; j < N; ++j)
-                    out.push_back(float(C.at(i,j)));
-            break;
-        }
-        case Backend::LUT: {
-            if (!lut) throw std::runtime_error("LUT not generated");
+    // ---------------------------------------------------------
+    //  Packed-weight reuse. With a budget set, matmul / submit look
+    //  up W by content in an LRU cache of packed weights and skip
+    //  the pack on a hit (see WeightCache); 0 disables the cache.
+    //  register_weights packs W once into a handle the caller keeps;
+    //  handles are not evicted and bypass the cache lookup.
+    // ---------------------------------------------------------
+    void set_weight_cache(size_t budget_bytes) { weight_cache_.set_budget(budget_bytes); }
+    WeightCacheStats weight_cache_stats() const { return weight_cache_.stats(); }
+    void clear_weight_cache() { weight_cache_.clear(); }
 
-            Matrix<uint8_t,RowMajor,Int4Storage> Wq(M,K);
-            for (int i = 0; i < M; ++i)
-                for (int j = 0; j < K; ++j)
-                    Wq.set(i,j, Wflat[size_t(i)*K + j]);
-            auto Wu = unpack_int4(Wq);
-            
-            std::vector<uint8_t> Au(size_t(K)*N);
-            for (int i = 0; i < K; ++i)
-                for (int j = 0; j < N; ++j) {
-                    float val = Aflat[size_t(i)*N + j];
-                    int q = std::lround(val);
-                    q = std::clamp(q, -8, 7);
-                    Au[size_t(i)*N + j] = uint8_t(q < 0 ? q + 16 : q);
-                }
-            
-            auto Ci = matmul_lut_fast(Wu, Au, M, K, N, *lut);
-            for (int i = 0; i < M; ++i)
-                for (int j = 0; j < N; ++j)
-                    out.push_back(float(Ci.at(i,j)));
-            break;
+    WeightHandle register_weights(const std::vector<uint8_t>& Wflat, int M, int K,
+                                  bool trans_w = false) const
+    {
+        check_weights(Wflat, M, K);
+        return WeightHandle(std::make_shared<const PackedWeights>(
+            pack_weights(Wflat, M, K, trans_w, pack_config(), numa)));
+    }
+
+    std::vector<float> matmul(const WeightHandle& W,
+                              const std::vector<float>& Aflat,
+                              int N, bool trans_a = false) const
+    {
+        if (!W) throw std::invalid_argument("empty weight handle");
+        if (W.w_->backend != backend || W.w_->numa != numa)
+            throw std::invalid_argument("weight handle was registered with a different backend or NUMA setting");
+        PreparedCall call = prepare_activations(W.w_, Aflat, N, trans_a);
+        return run_call(call, Aflat);
+    }
+
+    // ---------------------------------------------------------
+    //  Several weight matrices (Ws[w]: Ms[w] × K) times one shared
+    //  activation, e.g. fused Q/K/V or gate/up projections. The LUT
+    //  backend quantizes the activation and builds each table once
+    //  for all weights; other backends run one GEMM per weight.
+    // ---------------------------------------------------------
+    std::vector<std::vector<float>> matmul_multi(
+        const std::vector<std::vector<uint8_t>>& Ws,
+        const std::vector<int>& Ms,
+        const std::vector<float>& Aflat,
+        int K, int N,
+        bool trans_w = false, bool trans_a = false) const
+    {
+        if (Ws.size() != Ms.size())
+            throw std::invalid_argument("matmul_multi: one row count per weight matrix");
+        for (size_t w = 0; w < Ws.size(); ++w)
+            if (Ws[w].size() != size_t(Ms[w]) * K)
+                throw std::invalid_argument("matmul_multi: weights size does not match M × K");
+        std::vector<std::vector<float>> out;
+        out.reserve(Ws.size());
+        if (backend != Backend::LUT || numa) {
+            for (size_t w = 0; w < Ws.size(); ++w)
+                out.push_back(matmul(Ws[w], Aflat, Ms[w], K, N, trans_w, trans_a));
+            return out;
         }
-#ifdef USE_MKL
-        case Backend::MKL: {
-            Matrix<float,RowMajor,PlainStorage<float>> Wf(M,K), Af(K,N);
-            for (int i = 0; i < M; ++i)
-                for (int j = 0; j < K; ++j)
-                    Wf.set(i,j, float(Wflat[size_t(i)*K + j]));
-            for (int i = 0; i < K; ++i)
-                for (int j = 0; j < N; ++j)
-                    Af.set(i,j, Aflat[size_t(i)*N + j]);
-            auto C = matmul_mkl(Wf, Af);
-            for (int i = 0; i < M; ++i)
-                for (int j = 0; j < N; ++j)
-                    out.push_back(C.at(i,j));
-            break;
+        const auto cfg = lut_config();
+        const uint8_t mask = uint8_t((1u << cfg->bits) - 1);
+
+        std::vector<huge_vector<uint8_t>> Wu;
+        std::vector<const uint8_t*> ptrs;
+        std::vector<size_t> rows;
+        Wu.reserve(Ws.size());
+        for (size_t w = 0; w < Ws.size(); ++w) {
+            Wu.push_back(lut_codes(Ws[w], mask));
+            ptrs.push_back(Wu.back().data());
+            rows.push_back(size_t(Ms[w]));
         }
-#endif
-        default:
-            throw std::runtime_error("Unsupported backend");
+        auto Ci = matmul_lut_multi(ptrs, rows, lut_activation_values(Aflat), K, N,
+                                   cfg->table, 64, 4, Transpose{trans_w, trans_a});
+        for (auto& C : Ci)
+            out.emplace_back(C.data(), C.data() + C.rows() * C.cols());
+        return out;
+    }
+
+    // ---------------------------------------------------------
+    //  Out-of-core weights (LUT backend): W is read from a mapped
+    //  weight file panel by panel, keeping about `resident_bytes`
+    //  of it in memory (see matmul_lut_stream).
+    // ---------------------------------------------------------
+    std::vector<float> matmul_stream(const MappedWeights& W,
+                                     const std::vector<float>& Aflat,
+                                     int N,
+                                     size_t resident_bytes = size_t(64) << 20) const
+    {
+        if (backend != Backend::LUT)
+            throw std::runtime_error("matmul_stream is only valid for the LUT backend");
+        const auto cfg = lut_config();
+        if (cfg->bits != 4)
+            throw std::runtime_error("matmul_stream reads 4-bit weight files");
+        auto Ci = matmul_lut_stream(W, lut_activation_values(Aflat), size_t(N), cfg->table,
+                                    resident_bytes);
+        return std::vector<float>(Ci.data(), Ci.data() + Ci.rows() * Ci.cols());
+    }
+
+    // ---------------------------------------------------------
+    //  Half-precision I/O (IEEE binary16, see fp16_t). The W4A8
+    //  backend reads and writes halves inside its kernel; other
+    //  backends widen the activations once and narrow the result.
+    // ---------------------------------------------------------
+    std::vector<float> matmul(
+        const std::vector<uint8_t>& Wflat,
+        const std::vector<fp16_t>&  Aflat,
+        int M, int K, int N,
+        bool trans_w = false, bool trans_a = false) const
+    {
+        return matmul_half<float>(Wflat, Aflat, M, K, N, {trans_w, trans_a});
+    }
+
+    std::vector<fp16_t> matmul_fp16(
+        const std::vector<uint8_t>& Wflat,
+        const std::vector<fp16_t>&  Aflat,
+        int M, int K, int N,
+        bool trans_w = false, bool trans_a = false) const
+    {
+        return matmul_half<fp16_t>(Wflat, Aflat, M, K, N, {trans_w, trans_a});
+    }
+
+    // ---------------------------------------------------------
+    //  Asynchronous GEMM. Calls run through a two-stage pipeline
+    //  on the engine's own worker threads:
+    //    prepare — weight packing / activation quantization
+    //    compute — the backend kernel and output conversion
+    //  so the preparation of call n+1 overlaps the kernel of call
+    //  n. Results are delivered in submission order; `callback`
+    //  (optional) runs on the compute worker with the ready future.
+    // ---------------------------------------------------------
+    using MatmulFuture   = std::shared_future<std::vector<float>>;
+    using MatmulCallback = std::function<void(MatmulFuture)>;
+
+    MatmulFuture submit(std::vector<uint8_t> Wflat,
+                        std::vector<float>   Aflat,
+                        int M, int K, int N,
+                        MatmulCallback callback = nullptr)
+    {
+        std::call_once(pipeline_once, [this] {
+            pipeline = std::make_unique<AsyncPipeline>();
+            pipeline_ready.store(true, std::memory_order_release);
+        });
+
+        struct Job {
+            std::vector<uint8_t> W;
+            std::vector<float>   A;
+            int M, K, N;
+            MatmulCallback callback;
+            std::promise<std::vector<float>> promise;
+            std::optional<PreparedCall> call;
+        };
+        auto job = std::make_shared<Job>();
+        job->W = std::move(Wflat);
+        job->A = std::move(Aflat);
+        job->M = M; job->K = K; job->N = N;
+        job->callback = std::move(callback);
+        MatmulFuture fut = job->promise.get_future().share();
+
+        auto finish = [job, fut]() {
+            if (!job->callback) return;
+            try { job->callback(fut); } catch (...) { /* callback errors are dropped */ }
+        };
+        pipeline->prepare.post([this, job, finish]() {
+            try {
+                job->call.emplace(prepare_call(job->W, job->A, job->M, job->K, job->N));
+            } catch (...) {
+                job->promise.set_exception(std::current_exception());
+            }
+            // stage 2 is posted even on failure to keep completions ordered
+            pipeline->compute.post([this, job, finish]() {
+                if (job->call) {
+                    try {
+                        job->promise.set_value(run_call(*job->call, job->A));
+                    } catch (...) {
+                        job->promise.set_exception(std::current_exception());
+                    }
+                }
+                finish();
+            });
+        });
+        return fut;
+    }
+
+    // Calls submitted but not yet completed
+    size_t pending() const {
+        if (!pipeline_ready.load(std::memory_order_acquire)) return 0;
+        return pipeline->prepare.pending() + pipeline->compute.pending();
+    }
+
+    // ---------------------------------------------------------
+    //  In-process benchmark. Each method ("lut", "w4a8", "dequant",
+    //  "naive", "mkl"; empty = this engine's backend) runs on a fresh
+    //  engine with this engine's NUMA setting: `warmup` untimed calls,
+    //  then `num_runs` timed matmul calls (weight preparation
+    //  included, as callers see it). Inputs are random int4 weights
+    //  and integer activations in [-8, 7] (exact on every backend),
+    //  or the caller's data below.
+    // ---------------------------------------------------------
+    std::vector<BenchmarkResult> benchmark(
+        const std::vector<std::string>& methods = {},
+        int num_runs = 10,
+        const std::vector<BenchmarkShape>& shapes = {BenchmarkShape{}},
+        int warmup = 1) const
+    {
+        std::vector<BenchmarkResult> out;
+        std::mt19937 rng(2024);
+        std::uniform_int_distribution<int> d16(0, 15), dact(-8, 7);
+        for (const BenchmarkShape& sh : shapes) {
+            std::vector<uint8_t> W(size_t(sh.M) * sh.K);
+            std::vector<float>   A(size_t(sh.K) * sh.N);
+            for (auto& v : W) v = uint8_t(d16(rng));
+            for (auto& v : A) v = float(dact(rng));
+            auto r = benchmark(methods, num_runs, W, A, sh.M, sh.K, sh.N, warmup);
+            out.insert(out.end(), r.begin(), r.end());
         }
+        return out;
+    }
 
+    // Same, on caller-supplied weights (M × K nibbles) and activations (K × N)
+    std::vector<BenchmarkResult> benchmark(
+        const std::vector<std::string>& methods,
+        int num_runs,
+        const std::vector<uint8_t>& Wflat,
+        const std::vector<float>&   Aflat,
+        int M, int K, int N,
+        int warmup = 1) const
+    {
+        if (num_runs < 1) throw std::invalid_argument("num_runs must be at least 1");
+        if (Wflat.size() != size_t(M) * K || Aflat.size() != size_t(K) * N)
+            throw std::invalid_argument("benchmark: operand sizes do not match M, K, N");
+
+        // fp64 reference with two's-complement weights
+        std::vector<double> ref_d(size_t(M) * N, 0.0);
+        for (int i = 0; i < M; ++i)
+            for (int k = 0; k < K; ++k) {
+                int q = Wflat[size_t(i) * K + k] & 0x0F;
+                double w = q < 8 ? q : q - 16;
+                const float* a_row = &Aflat[size_t(k) * N];
+                double* r_row = &ref_d[size_t(i) * N];
+                for (int j = 0; j < N; ++j) r_row[j] += w * a_row[j];
+            }
+        std::vector<float> ref(ref_d.begin(), ref_d.end());
+
+        std::vector<BenchmarkResult> out;
+        for (const std::string& name : methods.empty() ? std::vector<std::string>{backend_name_}
+                                                        : methods) {
+            Engine eng(name);
+            eng.set_numa(numa);
+            if (eng.backend == Backend::LUT) eng.generate_lut(4);
+
+            std::vector<float> C;
+            for (int w = 0; w < warmup; ++w) C = eng.matmul(Wflat, Aflat, M, K, N);
+            std::vector<double> ms(static_cast<size_t>(num_runs));
+            for (auto& t : ms) {
+                auto t0 = std::chrono::steady_clock::now();
+                C = eng.matmul(Wflat, Aflat, M, K, N);
+                auto t1 = std::chrono::steady_clock::now();
+                t = std::chrono::duration<double, std::milli>(t1 - t0).count();
+            }
+            std::sort(ms.begin(), ms.end());
+
+            BenchmarkResult r;
+            r.method = name;
+            r.M = M; r.K = K; r.N = N;
+            r.runs = ms.size();
+            r.min_ms    = ms.front();
+            r.median_ms = ms.size() % 2 ? ms[ms.size() / 2]
+                                        : 0.5 * (ms[ms.size() / 2 - 1] + ms[ms.size() / 2]);
+            r.p95_ms    = ms[std::min(ms.size() - 1, size_t(0.95 * double(ms.size() - 1) + 0.5))];
+            double sum = 0.0;
+            for (double t : ms) sum += t;
+            r.mean_ms = sum / double(ms.size());
+            r.gflops  = r.median_ms > 0 ? 2.0 * M * K * double(N) / (r.median_ms * 1e6) : 0.0;
+            r.error   = measure_error(ref, C);
+            out.push_back(std::move(r));
+        }
         return out;
     }
 
-    // Bias addition
+    // Bias addition (one fused pass over the flat buffer)
     std::vector<float> add_bias(
         const std::vector<float>& Cflat,
         int M, int N,
         const std::vector<float>& bias) const
     {
-        Matrix<float,RowMajor,PlainStorage<float>> C(M,N);
-        for (int i = 0; i < M; ++i)
-            for (int j = 0; j < N; ++j)
-                C.set(i, j, Cflat[size_t(i)*N + j]);
-        auto R = ::add_bias(C, bias);
-        std::vector<float> out; out.reserve(size_t(M)*N);
-        for (int i = 0; i < M; ++i)
-            for (int j = 0; j < N; ++j)
-                out.push_back(R.at(i,j));
+        check_flat(Cflat, M, N);
+        std::vector<float> out(size_t(M) * N);
+        assign_to(::add_bias(MatView<float>(Cflat.data(), M, N), bias), out.data());
         return out;
     }
 
@@ -137,20 +459,256 @@ public:
         int M, int N,
         Activation act) const
     {
-        Matrix<float,RowMajor,PlainStorage<float>> C(M,N);
-        for (int i = 0; i < M; ++i)
-            for (int j = 0; j < N; ++j)
-                C.set(i, j, Cflat[size_t(i)*N + j]);
-        auto R = ::apply_activation(C, act);
-        std::vector<float> out; out.reserve(size_t(M)*N);
-        for (int i = 0; i < M; ++i)
-            for (int j = 0; j < N; ++j)
-                out.push_back(R.at(i,j));
+        check_flat(Cflat, M, N);
+        std::vector<float> out(size_t(M) * N);
+        assign_to(::apply_activation(MatView<float>(Cflat.data(), M, N), act), out.data());
         return out;
     }
 
 private:
+    using Lut = ProductLookupTable<uint8_t,int8_t,int32_t>;   // weight codes × int4 activation values
+
+    // Set by generate_lut: weight bit width and its per-level table
+    // (mirror-consolidated: only |w| rows are stored and built)
+    struct LutConfig {
+        int bits;
+        Lut table;
+        explicit LutConfig(int b) : bits(b), table(size_t(1) << b, 16, true) {}
+    };
+
+    // Per-call operands produced by the prepare stage
+    struct PreparedCall {
+        int M = 0, K = 0, N = 0;
+        Transpose trans;                                         // trans.w as W->trans_w
+        std::shared_ptr<const PackedWeights> W;
+        std::optional<Matrix<int,RowMajor,PlainStorage<int>>> Ai;   // naive
+        huge_vector<int8_t> As;                                     // lut: int4 values
+    };
+
+    struct AsyncPipeline {
+        SerialExecutor compute;   // declared first: destroyed after `prepare`
+        SerialExecutor prepare;   //   has drained into it
+    };
+
     Backend backend;
-    std::unique_ptr<ProductLookupTable<uint8_t,uint8_t,int32_t>> lut;
+    std::string backend_name_;
+    std::atomic<bool> numa{false};
+    std::shared_ptr<const LutConfig> lut;   // replaced whole by generate_lut; read via lut_config()
+    std::once_flag pipeline_once;
+    std::unique_ptr<AsyncPipeline> pipeline;
+    std::atomic<bool> pipeline_ready{false};
+    mutable WeightCache<PackedWeights> weight_cache_;
+
+    template<typename CT>
+    std::vector<CT> matmul_half(const std::vector<uint8_t>& Wflat,
+                                const std::vector<fp16_t>&  Aflat,
+                                int M, int K, int N, Transpose trans) const
+    {
+        if (Aflat.size() != size_t(K) * N)
+            throw std::invalid_argument("activations size does not match K × N");
+        std::vector<CT> out(size_t(M) * N);
+        if (backend == Backend::W4A8) {
+            matmul_w4a8(Wflat.data(), Aflat.data(), out.data(), M, K, N,
+                        nullptr, W4A8Path::Auto, 4, trans);
+            return out;
+        }
+        std::vector<float> Af(Aflat.size());
+        fp16_to_float(Aflat.data(), Af.data(), Af.size());
+        std::vector<float> C = matmul(Wflat, Af, M, K, N, trans.w, trans.a);
+        detail::store_row(C.data(), out.data(), C.size());
+        return out;
+    }
+
+    PreparedCall prepare_call(const std::vector<uint8_t>& Wflat,
+                              const std::vector<float>&   Aflat,
+                              int M, int K, int N,
+                              Transpose trans = {}) const
+    {
+        TraceScope span("prepare", "engine", "M", M, "N", N);
+        auto cfg = pack_config();
+        const bool on_nodes = numa;   // read once: key and pack agree
+        auto W = weight_cache_.get_or_pack(Wflat, WeightKey{M, K, trans.w, weight_bits(cfg.get()), on_nodes},
+            [&] { return pack_weights(Wflat, M, K, trans.w, cfg, on_nodes); },
+            [](const PackedWeights& p) { return p.bytes(); });
+        return prepare_activations(std::move(W), Aflat, N, trans.a);
+    }
+
+    // Snapshot of the current configuration; a concurrent generate_lut leaves it valid
+    std::shared_ptr<const LutConfig> lut_config() const {
+        auto c = std::atomic_load(&lut);
+        if (!c) throw std::runtime_error("LUT not generated");
+        return c;
+    }
+
+    // Configuration a pack is made for (null outside the LUT backend)
+    std::shared_ptr<const LutConfig> pack_config() const {
+        return backend == Backend::LUT ? lut_config() : nullptr;
+    }
+
+    // Bit width weights are packed as
+    static int weight_bits(const LutConfig* cfg) {
+        return cfg ? cfg->bits : 4;
+    }
+
+    static void check_flat(const std::vector<float>& C, int M, int N) {
+        if (M < 0 || N < 0 || C.size() != size_t(M) * N)
+            throw std::invalid_argument("buffer size does not match M × N");
+    }
+
+    static void check_weights(const std::vector<uint8_t>& Wflat, int M, int K) {
+        if (M < 1 || K < 1 || Wflat.size() != size_t(M) * K)
+            throw std::invalid_argument("weights size does not match M × K");
+    }
+
+    // Weight half of the prepare stage
+    PackedWeights pack_weights(const std::vector<uint8_t>& Wflat,
+                               int M, int K, bool trans_w,
+                               std::shared_ptr<const LutConfig> cfg, bool on_nodes) const
+    {
+        PackedWeights p;
+        p.backend = backend;
+        p.numa = on_nodes;
+        p.M = M; p.K = K;
+        p.bits = weight_bits(cfg.get());
+        p.trans_w = trans_w;
+        const Strides sw = Transpose{trans_w, false}.w_strides(M, K);
+
+        switch (backend) {
+        case Backend::Naive:
+            p.Wi.emplace(M, K);
+            for (int i = 0; i < M; ++i)
+                for (int j = 0; j < K; ++j) {
+                    int val = Wflat[sw(i, j)];
+                    p.Wi->set(i, j, val < 8 ? val : val - 16);
+                }
+            p.trans_w = false;
+            break;
+        case Backend::LUT: {
+            p.trans_w = false;
+            if (!p.numa) {
+                // bit planes; either storage order is read once here
+                p.Wb = std::make_unique<BitPlaneWeights>(
+                    pack_bit_planes(Wflat.data(), M, K, unsigned(p.bits), sw));
+                break;
+            }
+            // node-local slices are row-major, so NUMA reads K × M weights once here
+            const uint8_t mask = uint8_t((1u << p.bits) - 1);
+            p.lut = std::shared_ptr<const Lut>(cfg, &cfg->table);   // shares the engine's table
+            huge_vector<uint8_t> codes(size_t(M) * K);
+            for (int i = 0; i < M; ++i)
+                for (int j = 0; j < K; ++j)
+                    codes[size_t(i) * K + j] = Wflat[sw(i, j)] & mask;
+            p.Wn = std::make_unique<NumaWeights>(codes.data(), M, K);
+            break;
+        }
+        case Backend::W4A8:
+            // activations are quantized inside the kernel (fused per token)
+            p.Wu.assign(Wflat.begin(), Wflat.end());
+            break;
+        case Backend::Dequant:
+#ifdef USE_MKL
+        case Backend::MKL:
+#endif
+            // unit scales; re-laid out row-major
+            p.Wd = std::make_unique<DequantWeights>(Wflat.data(), nullptr, M, K,
+                                                    false, trans_w);
+            p.trans_w = false;
+            break;
+        default:
+            throw std::runtime_error("Unsupported backend");
+        }
+        return p;
+    }
+
+    // Activation half of the prepare stage
+    PreparedCall prepare_activations(std::shared_ptr<const PackedWeights> W,
+                                     const std::vector<float>& Aflat,
+                                     int N, bool trans_a) const
+    {
+        PreparedCall call;
+        call.M = W->M; call.K = W->K; call.N = N;
+        call.trans = Transpose{W->trans_w, trans_a};
+        call.W = std::move(W);
+        const int K = call.K;
+        if (Aflat.size() != size_t(K) * N)
+            throw std::invalid_argument("activations size does not match K × N");
+        const Strides sa = call.trans.a_strides(K, N);
+
+        switch (backend) {
+        case Backend::Naive:
+            call.Ai.emplace(K, N);
+            for (int i = 0; i < K; ++i)
+                for (int j = 0; j < N; ++j)
+                    call.Ai->set(i, j, (int)std::lround(Aflat[sa(i, j)]));
+            call.trans.a = false;
+            break;
+        case Backend::LUT:
+            call.As = lut_activation_values(Aflat);
+            break;
+        default:
+            break;   // read in place by the kernel
+        }
+        return call;
+    }
+
+    // low-bit weight codes (mask = 2^bits - 1), in the given order
+    static huge_vector<uint8_t> lut_codes(const std::vector<uint8_t>& Wflat, uint8_t mask) {
+        huge_vector<uint8_t> Wu(Wflat.size());
+        for (size_t i = 0; i < Wflat.size(); ++i) Wu[i] = Wflat[i] & mask;
+        return Wu;
+    }
+
+    // int4 activation values (rounded, clamped to [-8, 7]); element-wise,
+    // so the activation order is kept as given
+    static huge_vector<int8_t> lut_activation_values(const std::vector<float>& Aflat) {
+        huge_vector<int8_t> As(Aflat.size());
+        for (size_t i = 0; i < As.size(); ++i)
+            As[i] = int8_t(std::clamp<long>(std::lround(Aflat[i]), -8, 7));
+        return As;
+    }
+
+    std::vector<float> run_call(PreparedCall& call,
+                                const std::vector<float>& Aflat) const
+    {
+        const int M = call.M, K = call.K, N = call.N;
+        TraceScope span("compute", "engine", "M", M, "N", N);
+        std::vector<float> out;
+        out.reserve(size_t(M) * N);
+
+        switch (backend) {
+        case Backend::Naive: {
+            auto C = ::matmul(*call.W->Wi, *call.Ai);
+            for (int i = 0; i < M; ++i)
+                for (int j = 0; j < N; ++j)
+                    out.push_back(float(C.at(i,j)));
+            break;
+        }
+        case Backend::LUT: {
+            auto Ci = call.W->Wn ? matmul_lut_numa(*call.W->Wn, call.As, N, *call.W->lut, 64, 4,
+                                                   numa_topology(), call.trans)
+                                 : matmul_lut_bitserial(*call.W->Wb, call.As, N, 4, call.trans.a);
+            for (int i = 0; i < M; ++i)
+                for (int j = 0; j < N; ++j)
+                    out.push_back(float(Ci.at(i,j)));
+            break;
+        }
+        case Backend::W4A8:
+            // dynamic per-token int8 activations, rescaled in the epilogue
+            out.resize(size_t(M) * N);
+            matmul_w4a8(call.W->Wu.data(), Aflat.data(), out.data(), M, K, N,
+                        nullptr, W4A8Path::Auto, 4, call.trans);
+            break;
+        case Backend::Dequant:
+#ifdef USE_MKL
+        case Backend::MKL:
+#endif
+            out.resize(size_t(M) * N);
+            call.W->Wd->matmul(Aflat.data(), out.data(), N, 4, call.trans.a);
+            break;
+        default:
+            throw std::runtime_error("Unsupported backend");
+        }
+        return out;
+    }
 };
 
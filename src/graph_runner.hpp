@@ -0,0 +1,141 @@
+#pragma once
+#include <vector>
+#include <string>
+#include <memory>
+#include <chrono>
+#include <cstring>
+#include <algorithm>
+#include <stdexcept>
+
+#include "matrix_ops.hpp"
+#include "post_processing.hpp"
+#include "dequant_gemm.hpp"
+
+// =============================================================
+//  LinearGraph — a sequence of quantized linear layers
+//      Y_l = act_l( W_l · Y_{l-1} + b_l )
+//  built once, then run back-to-back in C++.
+//  * W_l shape: out_l × in_l int4 nibbles (two's complement),
+//    optional per-row scales; b_l has out_l entries
+//  * activations are feature-major: in_0 × N (N tokens)
+//  The graph owns its kernel-ready weights and two activation
+//  buffers that layers alternate between (ping-pong); bias and
+//  activation run as one in-place pass on the layer output.
+//  Backends: "w4a8" (dynamic per-token int8 activations) or
+//  "dequant" (float weights dequantized at add time).
+// =============================================================
+class LinearGraph {
+public:
+    explicit LinearGraph(const std::string& backend = "w4a8",
+                         size_t num_threads = 4)
+      : num_threads_(num_threads)
+    {
+        if      (backend == "w4a8")    dequant_ = false;
+        else if (backend == "dequant") dequant_ = true;
+        else throw std::invalid_argument("Unknown graph backend: " + backend);
+    }
+
+    void add_linear(const std::vector<uint8_t>& W,
+                    size_t out_features, size_t in_features,
+                    const std::vector<float>& scales = {},
+                    const std::vector<float>& bias = {},
+                    Activation act = Activation::Linear)
+    {
+        if (W.size() != out_features * in_features)
+            throw std::invalid_argument("weights size does not match out × in");
+        if (!scales.empty() && scales.size() != out_features)
+            throw std::invalid_argument("scales must have one entry per output feature");
+        if (!bias.empty() && bias.size() != out_features)
+            throw std::invalid_argument("bias must have one entry per output feature");
+        if (!layers_.empty() && layers_.back().out != in_features)
+            throw std::invalid_argument("layer input size does not match previous output");
+
+        Layer L;
+        L.out = out_features;
+        L.in  = in_features;
+        L.bias = bias;
+        L.act = act;
+        if (dequant_) {
+            L.Wd = std::make_unique<DequantWeights>(
+                W.data(), scales.empty() ? nullptr : scales.data(),
+                out_features, in_features);
+        } else {
+            L.Wq = W;
+            L.scales = scales;
+        }
+        layers_.push_back(std::move(L));
+        max_width_ = std::max(max_width_, out_features);
+        timings_.assign(layers_.size(), 0.0);
+    }
+
+    // Preallocate the ping-pong buffers for up to max_tokens tokens
+    void reserve(size_t max_tokens) {
+        size_t need = max_width_ * max_tokens;
+        if (buf_[0].size() < need) {
+            buf_[0].resize(need);
+            buf_[1].resize(need);
+        }
+    }
+
+    // X: in_0 × N, Y: out_last × N (both row-major)
+    void run(const float* X, float* Y, size_t N) {
+        if (layers_.empty()) throw std::runtime_error("graph has no layers");
+        reserve(N);
+
+        const float* src = X;
+        for (size_t l = 0; l < layers_.size(); ++l) {
+            Layer& L = layers_[l];
+            float* dst = buf_[l % 2].data();
+            TraceScope span("layer", "graph", "layer", int64_t(l));
+            auto t0 = std::chrono::high_resolution_clock::now();
+            if (L.Wd) {
+                L.Wd->matmul(src, dst, N, num_threads_);
+            } else {
+                matmul_w4a8(L.Wq.data(), src, dst, L.out, L.in, N,
+                            L.scales.empty() ? nullptr : L.scales.data(),
+                            W4A8Path::Auto, num_threads_);
+            }
+            if (!L.bias.empty() || L.act != Activation::Linear)
+                bias_activation_rows_inplace(dst, L.out, N,
+                                             L.bias.empty() ? nullptr : L.bias.data(),
+                                             L.act);
+            auto t1 = std::chrono::high_resolution_clock::now();
+            timings_[l] = std::chrono::duration<double, std::milli>(t1 - t0).count();
+            src = dst;
+        }
+        std::memcpy(Y, src, layers_.back().out * N * sizeof(float));
+    }
+
+    std::vector<float> run(const std::vector<float>& X, size_t N) {
+        if (layers_.empty()) throw std::runtime_error("graph has no layers");
+        if (X.size() != layers_.front().in * N)
+            throw std::invalid_argument("input size does not match in_features × N");
+        std::vector<float> Y(layers_.back().out * N);
+        run(X.data(), Y.data(), N);
+        return Y;
+    }
+
+    size_t num_layers() const noexcept { return layers_.size(); }
+    size_t input_features() const { return layers_.empty() ? 0 : layers_.front().in; }
+    size_t output_features() const { return layers_.empty() ? 0 : layers_.back().out; }
+
+    // Wall time of each layer (GEMM + epilogue) in the last run, in ms
+    const std::vector<double>& layer_times_ms() const noexcept { return timings_; }
+
+private:
+    struct Layer {
+        size_t out = 0, in = 0;
+        std::vector<uint8_t> Wq;              // w4a8
+        std::vector<float> scales;
+        std::unique_ptr<DequantWeights> Wd;   // dequant
+        std::vector<float> bias;
+        Activation act = Activation::Linear;
+    };
+
+    bool dequant_ = false;
+    size_t num_threads_;
+    size_t max_width_ = 0;
+    std::vector<Layer> layers_;
+    std::vector<float> buf_[2];
+    std::vector<double> timings_;
+};
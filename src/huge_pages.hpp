@@ -0,0 +1,283 @@
+#pragma once
+#include <algorithm>
+#include <atomic>
+#include <cctype>
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>    // posix_memalign, free
+#include <fstream>
+#include <map>
+#include <mutex>
+#include <new>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#ifdef __linux__
+#include <sys/mman.h>
+#endif
+
+// =============================================================
+//  Huge-page backed allocation
+//  set_huge_pages() selects how allocations of at least
+//  `min_bytes` (default 2 MiB, at least 1 MiB) are backed:
+//    Off         — posix_memalign, as before (default)
+//    Transparent — anonymous mmap aligned to 2 MiB and marked
+//                  MADV_HUGEPAGE, so THP can back it with 2 MiB
+//                  pages (needs THP "madvise" or "always")
+//    Explicit    — MAP_HUGETLB from the reserved hugetlbfs pool
+//                  (vm.nr_hugepages); falls back to Transparent
+//                  when the pool cannot satisfy the request
+//  AlignedAllocator (Matrix storage, lookup tables, packed
+//  weights, engine scratch via huge_vector) goes through
+//  huge_alloc, so the setting applies to allocations made after
+//  the call. Every block carries a small header recording how it
+//  was obtained, so frees stay correct when the mode changes.
+//  huge_page_report() reads /proc/self/smaps and reports how much
+//  of the live huge-page allocations the kernel actually backed
+//  with huge pages.
+// =============================================================
+
+enum class HugePages { Off, Transparent, Explicit };
+
+constexpr size_t kHugePageSize = size_t(2) << 20;
+
+struct HugePageReport {
+    size_t allocations = 0;       // live blocks on the huge-page path
+    size_t requested_bytes = 0;   // their size
+    size_t thp_bytes = 0;         // backed by transparent huge pages
+    size_t hugetlb_bytes = 0;     // backed by the hugetlbfs pool
+    size_t process_thp_bytes = 0; // AnonHugePages of the whole process
+    double huge_fraction() const {
+        return requested_bytes ? double(thp_bytes + hugetlb_bytes) / double(requested_bytes) : 0.0;
+    }
+};
+
+namespace detail {
+
+enum class HugeKind : uint32_t { Malloc, Thp, HugeTlb };
+
+struct HugeHeader {
+    void*    base;      // start of the malloc block / mapping
+    size_t   map_len;   // mapping length (0 for malloc)
+    HugeKind kind;
+};
+
+struct HugeRegion {
+    uintptr_t begin, end;   // user range
+    HugeKind kind;
+};
+
+struct HugePageState {
+    std::atomic<int>    mode{int(HugePages::Off)};
+    std::atomic<size_t> min_bytes{kHugePageSize};
+    std::mutex mtx;
+    std::map<uintptr_t, HugeRegion> regions;   // keyed by user pointer
+};
+
+inline HugePageState& huge_state() {
+    static HugePageState s;
+    return s;
+}
+
+inline size_t round_up(size_t v, size_t a) { return (v + a - 1) / a * a; }
+
+// smaps VMA header "<hex>-<hex> perms ...": parses the address range,
+// rejects attribute lines ("Size:  4 kB", "VmFlags: ...")
+inline bool parse_vma_header(const std::string& line, uintptr_t& lo, uintptr_t& hi) {
+    auto hex_run = [&](size_t i) {
+        while (i < line.size() && std::isxdigit(static_cast<unsigned char>(line[i]))) ++i;
+        return i;
+    };
+    const size_t dash = hex_run(0);
+    if (dash == 0 || dash >= line.size() || line[dash] != '-') return false;
+    const size_t end = hex_run(dash + 1);
+    if (end == dash + 1 || end >= line.size() || line[end] != ' ') return false;
+    lo = uintptr_t(std::stoull(line.substr(0, dash), nullptr, 16));
+    hi = uintptr_t(std::stoull(line.substr(dash + 1, end - dash - 1), nullptr, 16));
+    return true;
+}
+
+// Header slot in front of the user pointer, keeping `align`
+inline size_t header_pad(size_t align) {
+    return round_up(sizeof(HugeHeader), align < alignof(HugeHeader) ? alignof(HugeHeader) : align);
+}
+
+#ifdef __linux__
+// mmap path; returns nullptr when the kernel refuses
+inline void* huge_map(size_t bytes, size_t pad, bool explicit_pool, HugeKind& kind,
+                      void*& base, size_t& map_len) {
+#ifdef MAP_HUGETLB
+    if (explicit_pool) {
+        map_len = round_up(pad + bytes, kHugePageSize);
+        void* p = mmap(nullptr, map_len, PROT_READ | PROT_WRITE,
+                       MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+        if (p != MAP_FAILED) {
+            kind = HugeKind::HugeTlb;
+            base = p;
+            return static_cast<char*>(p) + pad;
+        }
+    }
+#else
+    (void)explicit_pool;
+#endif
+    // THP: user range starts on a 2 MiB boundary; header sits just below it
+    const size_t body = round_up(bytes, kHugePageSize);
+    map_len = body + kHugePageSize + round_up(pad, 4096);
+    void* p = mmap(nullptr, map_len, PROT_READ | PROT_WRITE,
+                   MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (p == MAP_FAILED) return nullptr;
+    uintptr_t user = round_up(reinterpret_cast<uintptr_t>(p) + pad, kHugePageSize);
+#ifdef MADV_HUGEPAGE
+    madvise(reinterpret_cast<void*>(user), body, MADV_HUGEPAGE);
+#endif
+    kind = HugeKind::Thp;
+    base = p;
+    return reinterpret_cast<void*>(user);
+}
+#endif
+
+} // namespace detail
+
+// Each huge-page block gets its own mapping: the body is rounded up
+// to whole 2 MiB pages (THP maps another 2 MiB of alignment slack,
+// which is never touched), so a block pins up to one huge page more
+// than it uses. min_bytes is clamped to kHugePageSize / 2, keeping
+// that overhead at most 2× the block size.
+inline void set_huge_pages(HugePages mode, size_t min_bytes = kHugePageSize) {
+    auto& s = detail::huge_state();
+    s.min_bytes.store(std::max(min_bytes, kHugePageSize / 2), std::memory_order_relaxed);
+    s.mode.store(int(mode), std::memory_order_relaxed);
+}
+
+inline HugePages huge_pages_mode() {
+    return HugePages(detail::huge_state().mode.load(std::memory_order_relaxed));
+}
+
+// `bytes` aligned to `align` (power of two); huge-page backed per
+// set_huge_pages. Release with huge_free.
+inline void* huge_alloc(size_t bytes, size_t align = 64) {
+    using namespace detail;
+    auto& s = huge_state();
+    const size_t pad = header_pad(align);
+    const HugePages mode = HugePages(s.mode.load(std::memory_order_relaxed));
+    void* user = nullptr;
+    HugeHeader h{nullptr, 0, HugeKind::Malloc};
+#ifdef __linux__
+    if (mode != HugePages::Off && bytes >= s.min_bytes.load(std::memory_order_relaxed))
+        user = huge_map(bytes, pad, mode == HugePages::Explicit, h.kind, h.base, h.map_len);
+#endif
+    if (!user) {
+        if (posix_memalign(&h.base, align < sizeof(void*) ? sizeof(void*) : align, pad + bytes) != 0)
+            throw std::bad_alloc();
+        h.kind = HugeKind::Malloc;
+        h.map_len = 0;
+        user = static_cast<char*>(h.base) + pad;
+    }
+    reinterpret_cast<HugeHeader*>(user)[-1] = h;
+    if (h.kind != HugeKind::Malloc) {
+        std::lock_guard<std::mutex> lk(s.mtx);
+        const uintptr_t u = reinterpret_cast<uintptr_t>(user);
+        s.regions[u] = HugeRegion{u, u + bytes, h.kind};
+    }
+    return user;
+}
+
+inline void huge_free(void* p) noexcept {
+    using namespace detail;
+    if (!p) return;
+    const HugeHeader h = reinterpret_cast<HugeHeader*>(p)[-1];
+    if (h.kind == HugeKind::Malloc) { free(h.base); return; }
+    {
+        auto& s = huge_state();
+        std::lock_guard<std::mutex> lk(s.mtx);
+        s.regions.erase(reinterpret_cast<uintptr_t>(p));
+    }
+#ifdef __linux__
+    munmap(h.base, h.map_len);
+#endif
+}
+
+// Attributes each smaps VMA's AnonHugePages / Private_Hugetlb to the
+// live huge-page blocks inside it (capped at their size there)
+inline HugePageReport huge_page_report() {
+    using namespace detail;
+    HugePageReport r;
+    std::vector<HugeRegion> regions;
+    {
+        auto& s = huge_state();
+        std::lock_guard<std::mutex> lk(s.mtx);
+        for (const auto& kv : s.regions) {
+            regions.push_back(kv.second);
+            r.requested_bytes += kv.second.end - kv.second.begin;
+        }
+    }
+    r.allocations = regions.size();
+
+    std::ifstream f("/proc/self/smaps");
+    std::string line;
+    uintptr_t lo = 0, hi = 0;
+    auto overlap = [&](HugeKind kind) {
+        size_t n = 0;
+        for (const auto& g : regions) {
+            if (g.kind != kind) continue;
+            uintptr_t b = g.begin > lo ? g.begin : lo, e = g.end < hi ? g.end : hi;
+            if (b < e) n += e - b;
+        }
+        return n;
+    };
+    while (std::getline(f, line)) {
+        if (line.empty()) continue;
+        if (parse_vma_header(line, lo, hi)) continue;
+        const bool thp = line.rfind("AnonHugePages:", 0) == 0;
+        const bool tlb = line.rfind("Private_Hugetlb:", 0) == 0;
+        if (!thp && !tlb) continue;
+        std::istringstream is(line.substr(line.find(':') + 1));
+        size_t kb = 0;
+        is >> kb;
+        const size_t bytes = kb << 10;
+        if (thp) r.process_thp_bytes += bytes;
+        if (!bytes) continue;
+        const size_t mine = overlap(thp ? HugeKind::Thp : HugeKind::HugeTlb);
+        (thp ? r.thp_bytes : r.hugetlb_bytes) += bytes < mine ? bytes : mine;
+    }
+    return r;
+}
+
+// Aligned allocator with compile-time check; huge-page backed for
+// large blocks when enabled (see set_huge_pages)
+template<typename T, std::size_t Align>
+struct AlignedAllocator {
+    static_assert((Align & (Align - 1)) == 0 && Align >= alignof(T),
+                  "Align must be power-of-two and at least alignof(T)");
+
+    using value_type      = T;
+    using pointer         = T*;
+    using const_pointer   = const T*;
+    using reference       = T&;
+    using const_reference = const T&;
+    using size_type       = std::size_t;
+    using difference_type = std::ptrdiff_t;
+
+    template<typename U>
+    struct rebind { using other = AlignedAllocator<U, Align>; };
+
+    AlignedAllocator() noexcept {}
+    template<typename U>
+    AlignedAllocator(const AlignedAllocator<U, Align>&) noexcept {}
+
+    bool operator==(AlignedAllocator const&) const noexcept { return true; }
+    bool operator!=(AlignedAllocator const&) const noexcept { return false; }
+
+    pointer allocate(size_type n) {
+        return static_cast<pointer>(huge_alloc(n * sizeof(T), Align));
+    }
+
+    void deallocate(pointer p, size_type) noexcept {
+        huge_free(p);
+    }
+};
+
+// 64-byte aligned vector for large buffers (weights, scratch)
+template<typename T>
+using huge_vector = std::vector<T, AlignedAllocator<T, 64>>;
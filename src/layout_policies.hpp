@@ -1,14 +1,39 @@
 #pragma once
 #include <cstddef>   // for size_t
 
+// Element strides of a rows × cols operand in a flat buffer:
+// element (r, c) lives at r * row + c * col
+struct Strides {
+    size_t row, col;
+    size_t operator()(size_t r, size_t c) const noexcept { return r * row + c * col; }
+};
+
 struct RowMajor {
     static size_t index(size_t row, size_t col, size_t /*nrows*/, size_t ncols) {
         return row * ncols + col;
     }
+    static Strides strides(size_t /*nrows*/, size_t ncols) { return {ncols, 1}; }
 };
 
 struct ColMajor {
     static size_t index(size_t row, size_t col, size_t nrows, size_t /*ncols*/) {
         return col * nrows + row;
     }
+    static Strides strides(size_t nrows, size_t /*ncols*/) { return {1, nrows}; }
+};
+
+// GEMM operand orders for raw-buffer kernels (BLAS-style N/T flags):
+//   w: W is stored K × M (a column-major M × K matrix) instead of M × K
+//   a: A is stored N × K (token-major) instead of K × N
+// Kernels read the given order directly; nothing is transposed.
+struct Transpose {
+    bool w = false;
+    bool a = false;
+
+    Strides w_strides(size_t M, size_t K) const noexcept {
+        return w ? ColMajor::strides(M, K) : RowMajor::strides(M, K);
+    }
+    Strides a_strides(size_t K, size_t N) const noexcept {
+        return a ? ColMajor::strides(K, N) : RowMajor::strides(K, N);
+    }
 };
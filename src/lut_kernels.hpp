@@ -0,0 +1,252 @@
+#pragma once
+#include <vector>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <algorithm>
+#include <type_traits>
+
+#include "layout_policies.hpp"
+#include "lut_utils.hpp"
+
+// =============================================================
+//  LUT register-tile micro-kernels
+//  The LUT GEMM builds a panel of `depth` tables (one per k) and
+//  multiplies it in MR × NR blocks of C: the block's accumulators
+//  stay in registers across the whole panel and C is read and
+//  written once per panel instead of once per k.
+//  lut_micro<MR, NR, BITS, P> is instantiated for a curated set of
+//  register tiles and weight bit widths, per ISA (generic and an
+//  AVX2 clone), and selected at run time from kLutMicroKernels by
+//  (shape class of the tile's columns, bit width, ISA). Blocks the
+//  selected tile does not cover — and tables with no matching
+//  entry — go through the runtime-sized lut_micro_edge.
+// =============================================================
+
+inline bool cpu_has_avx2() {
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+    static const bool has = __builtin_cpu_supports("avx2");
+    return has;
+#else
+    return false;
+#endif
+}
+
+enum class KernelIsa { Generic, AVX2 };
+
+inline KernelIsa runtime_isa() {
+    return cpu_has_avx2() ? KernelIsa::AVX2 : KernelIsa::Generic;
+}
+
+// Tile column count classes: decode-like (1–7 tokens), medium, wide
+enum class LutShapeClass { Narrow, Medium, Wide };
+
+inline LutShapeClass lut_shape_class(size_t cols) {
+    return cols < 8 ? LutShapeClass::Narrow : cols < 16 ? LutShapeClass::Medium
+                                                        : LutShapeClass::Wide;
+}
+
+namespace detail {
+
+// Table row of weight code q and whether it is negated (mirror mode)
+template <typename P>
+inline const P* lut_table_row(const P* T, size_t ld, unsigned q, unsigned levels,
+                              bool mirror, P& sign_mask) {
+    const bool neg = mirror && q >= levels / 2;
+    sign_mask = neg ? P(-1) : P(0);
+    return T + size_t(neg ? levels - q : q) * ld;
+}
+
+// C(rows × cols) += Σ_kk ±T_kk[|W(r, kk)|][j0:j0 + cols], any rows / cols
+// (C points at column j0 of the block)
+template <typename P>
+void lut_micro_edge(const uint8_t* W, Strides ws, const P* const* tables, size_t ld,
+                    size_t kc, unsigned levels, bool mirror,
+                    P* C, size_t ldc, size_t rows, size_t j0, size_t cols)
+{
+    for (size_t r = 0; r < rows; ++r) {
+        P* c_row = C + r * ldc;
+        for (size_t kk = 0; kk < kc; ++kk) {
+            P m;
+            const P* row = j0 + lut_table_row(tables[kk], ld, W[ws(r, kk)], levels, mirror, m);
+            for (size_t j = 0; j < cols; ++j) c_row[j] += (row[j] ^ m) - m;
+        }
+    }
+}
+
+// Eight P lanes as one GCC vector (a ymm register for int32 on AVX2)
+template <typename P>
+struct LutLanes {
+    static constexpr int kWidth = 8;
+    typedef P type __attribute__((vector_size(sizeof(P) * kWidth)));
+};
+
+// One full MR × NR block at table column j0; the loops have constant
+// trip counts, so they unroll and `acc` is register-allocated (NR a
+// multiple of 8: vectors of LutLanes, otherwise scalars).
+template <int MR, int NR, int BITS, typename P>
+[[gnu::always_inline]] inline void
+lut_micro_body(const uint8_t* W, Strides ws, const P* const* tables, size_t ld,
+               size_t j0, size_t kc, bool mirror, P* C, size_t ldc)
+{
+    constexpr unsigned levels = 1u << BITS;
+    if constexpr (NR % LutLanes<P>::kWidth == 0) {
+        using V = typename LutLanes<P>::type;
+        constexpr int NV = NR / LutLanes<P>::kWidth;
+        V acc[MR][NV] = {};
+        for (size_t kk = 0; kk < kc; ++kk) {
+            const P* T = tables[kk] + j0;
+#pragma GCC unroll 16
+            for (int r = 0; r < MR; ++r) {
+                P m;
+                const P* row = lut_table_row(T, ld, W[ws(size_t(r), kk)], levels, mirror, m);
+                const V mv = V{} + m;
+#pragma GCC unroll 8
+                for (int v = 0; v < NV; ++v) {
+                    V x;
+                    std::memcpy(&x, row + v * LutLanes<P>::kWidth, sizeof(V));
+                    acc[r][v] += (x ^ mv) - mv;
+                }
+            }
+        }
+#pragma GCC unroll 16
+        for (int r = 0; r < MR; ++r)
+#pragma GCC unroll 8
+            for (int v = 0; v < NV; ++v) {
+                P* c = C + size_t(r) * ldc + v * LutLanes<P>::kWidth;
+                V x;
+                std::memcpy(&x, c, sizeof(V));
+                x += acc[r][v];
+                std::memcpy(c, &x, sizeof(V));
+            }
+    } else {
+        P acc[MR][NR] = {};
+        for (size_t kk = 0; kk < kc; ++kk) {
+            const P* T = tables[kk] + j0;
+#pragma GCC unroll 16
+            for (int r = 0; r < MR; ++r) {
+                P m;
+                const P* row = lut_table_row(T, ld, W[ws(size_t(r), kk)], levels, mirror, m);
+#pragma GCC unroll 8
+                for (int j = 0; j < NR; ++j) acc[r][j] += (row[j] ^ m) - m;
+            }
+        }
+#pragma GCC unroll 16
+        for (int r = 0; r < MR; ++r)
+#pragma GCC unroll 8
+            for (int j = 0; j < NR; ++j) C[size_t(r) * ldc + j] += acc[r][j];
+    }
+}
+
+template <typename P>
+using LutMicroFn = void (*)(const uint8_t* W, Strides ws, const P* const* tables, size_t ld,
+                            size_t j0, size_t kc, bool mirror, P* C, size_t ldc);
+
+template <int MR, int NR, int BITS, typename P>
+void lut_micro(const uint8_t* W, Strides ws, const P* const* tables, size_t ld,
+               size_t j0, size_t kc, bool mirror, P* C, size_t ldc)
+{
+    lut_micro_body<MR, NR, BITS, P>(W, ws, tables, ld, j0, kc, mirror, C, ldc);
+}
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define MPGEMM_LUT_AVX2 1
+template <int MR, int NR, int BITS, typename P>
+__attribute__((target("avx2")))
+void lut_micro_avx2(const uint8_t* W, Strides ws, const P* const* tables, size_t ld,
+                    size_t j0, size_t kc, bool mirror, P* C, size_t ldc)
+{
+    lut_micro_body<MR, NR, BITS, P>(W, ws, tables, ld, j0, kc, mirror, C, ldc);
+}
+#endif
+
+} // namespace detail
+
+struct LutMicroKernel {
+    LutShapeClass shape;
+    KernelIsa isa;
+    int bits;
+    int mr, nr;
+    detail::LutMicroFn<int32_t> fn;
+};
+
+#define MPGEMM_LUT_ENTRY(SHAPE, MR, NR, BITS)                                                 \
+    LutMicroKernel{LutShapeClass::SHAPE, KernelIsa::Generic, BITS, MR, NR,                   \
+                   &detail::lut_micro<MR, NR, BITS, int32_t>}
+#ifdef MPGEMM_LUT_AVX2
+#define MPGEMM_LUT_ENTRY_AVX2(SHAPE, MR, NR, BITS)                                            \
+    LutMicroKernel{LutShapeClass::SHAPE, KernelIsa::AVX2, BITS, MR, NR,                      \
+                   &detail::lut_micro_avx2<MR, NR, BITS, int32_t>},
+#else
+#define MPGEMM_LUT_ENTRY_AVX2(SHAPE, MR, NR, BITS)
+#endif
+#define MPGEMM_LUT_ENTRIES(SHAPE, MR, NR, BITS) \
+    MPGEMM_LUT_ENTRY_AVX2(SHAPE, MR, NR, BITS) MPGEMM_LUT_ENTRY(SHAPE, MR, NR, BITS)
+
+// Curated instantiations (int32 products). Narrow: one column, eight
+// rows of scalar accumulators; Medium / Wide: one or two 8-lane
+// vectors per row.
+inline constexpr LutMicroKernel kLutMicroKernels[] = {
+    MPGEMM_LUT_ENTRIES(Narrow, 8, 1, 4),
+    MPGEMM_LUT_ENTRIES(Medium, 8, 8, 4),
+    MPGEMM_LUT_ENTRIES(Wide,   4, 16, 4),
+    MPGEMM_LUT_ENTRIES(Narrow, 8, 1, 2),
+    MPGEMM_LUT_ENTRIES(Medium, 8, 8, 2),
+    MPGEMM_LUT_ENTRIES(Wide,   4, 16, 2),
+};
+
+#undef MPGEMM_LUT_ENTRIES
+#undef MPGEMM_LUT_ENTRY_AVX2
+#undef MPGEMM_LUT_ENTRY
+
+// Kernel for a tile `cols` wide over a table of `levels` weight codes,
+// or nullptr (edge kernel only)
+template <typename P>
+const LutMicroKernel* select_lut_micro_kernel(size_t levels, size_t cols,
+                                              KernelIsa isa = runtime_isa())
+{
+    if constexpr (!std::is_same_v<P, int32_t>) {
+        (void)levels; (void)cols; (void)isa;
+        return nullptr;
+    } else {
+        const LutShapeClass shape = lut_shape_class(cols);
+        for (const LutMicroKernel& k : kLutMicroKernels)
+            if (k.shape == shape && k.isa == isa && (size_t(1) << k.bits) == levels)
+                return &k;
+        return nullptr;
+    }
+}
+
+namespace detail {
+
+// Per-worker panel of `depth` activation tables, one per k. The depth
+// keeps the panel within about kPanelBytes so it stays cache-resident.
+template <typename A, typename P = int32_t>
+class LutPanel {
+public:
+    static constexpr size_t kMaxDepth   = 16;
+    static constexpr size_t kPanelBytes = size_t(256) << 10;
+
+    LutPanel(size_t levels, size_t width, bool mirror) {
+        ProductLookupTable<uint8_t, A, P> first(levels, width, mirror);
+        const size_t depth = std::clamp<size_t>(kPanelBytes / std::max<size_t>(1, first.lut_size_bytes()),
+                                                1, kMaxDepth);
+        tables_.reserve(depth);
+        tables_.push_back(std::move(first));
+        while (tables_.size() < depth) tables_.emplace_back(levels, width, mirror);
+        for (auto& t : tables_) ptrs_.push_back(t.data());
+    }
+
+    size_t depth() const noexcept { return tables_.size(); }
+    ProductLookupTable<uint8_t, A, P>& table(size_t i) noexcept { return tables_[i]; }
+    const P* const* tables() const noexcept { return ptrs_.data(); }
+    size_t row_stride() const noexcept { return tables_[0].row_stride(); }
+    size_t weight_levels() const noexcept { return tables_[0].weight_levels(); }
+    bool mirrored() const noexcept { return tables_[0].mirrored(); }
+
+private:
+    std::vector<ProductLookupTable<uint8_t, A, P>> tables_;
+    std::vector<const P*> ptrs_;
+};
+
+} // namespace detail
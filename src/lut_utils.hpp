@@ -3,46 +3,10 @@
 #include <vector>
 #include <cstddef>
 #include <type_traits>
-#include <cstdlib>    // posix_memalign, free
 #include <memory>
 #include <limits>
 #include <cstdint>
-
-// Aligned allocator with compile-time check
-template<typename T, std::size_t Align>
-struct AlignedAllocator {
-    static_assert((Align & (Align - 1)) == 0 && Align >= alignof(T),
-                  "Align must be power-of-two and at least alignof(T)");
-
-    using value_type      = T;
-    using pointer         = T*;
-    using const_pointer   = const T*;
-    using reference       = T&;
-    using const_reference = const T&;
-    using size_type       = std::size_t;
-    using difference_type = std::ptrdiff_t;
-
-    template<typename U>
-    struct rebind { using other = AlignedAllocator<U, Align>; };
-
-    AlignedAllocator() noexcept {}
-    template<typename U>
-    AlignedAllocator(const AlignedAllocator<U, Align>&) noexcept {}
-
-    bool operator==(AlignedAllocator const&) const noexcept { return true; }
-    bool operator!=(AlignedAllocator const&) const noexcept { return false; }
-
-    pointer allocate(size_type n) {
-        void* ptr = nullptr;
-        if (posix_memalign(&ptr, Align, n * sizeof(T)) != 0)
-            throw std::bad_alloc();
-        return static_cast<pointer>(ptr);
-    }
-
-    void deallocate(pointer p, size_type) noexcept {
-        free(p);
-    }
-};
+#include "huge_pages.hpp"   // AlignedAllocator
 
 // Lookup table for product of two integers, 64-byte aligned
 // W: weight type, A: activation type, P: product type
@@ -53,11 +17,19 @@ public:
     using ActivationType = A;
     using ProductType    = P;
 
-    ProductLookupTable(std::size_t weight_levels, std::size_t a_range)
+    static constexpr std::size_t npos = static_cast<std::size_t>(-1);
+
+    // mirror = true stores only the rows of non-negative weight magnitudes
+    // (0 … weight_levels/2). Two's-complement row -w is the negation of row w,
+    // so the sign is applied by the caller during accumulation (T-MAC style).
+    ProductLookupTable(std::size_t weight_levels, std::size_t a_range,
+                       bool mirror = false)
         : weight_levels_(weight_levels),
           a_range_(a_range),
           padded_a_range_(((a_range + 7) / 8) * 8),
-          table_(weight_levels * padded_a_range_)
+          mirror_(mirror),
+          stored_rows_(mirror ? weight_levels / 2 + 1 : weight_levels),
+          table_(stored_rows_ * padded_a_range_)
     {
         // Default: build LUT with raw indices as activations
         fill_impl([&](std::size_t a) -> int64_t {
@@ -72,24 +44,42 @@ public:
         });
     }
 
-    void fill_from_activation(const ActivationType* act_row) noexcept {
-        // Refill LUT with actual activation values
+    // Refill LUT with actual activation values. `count` (≤ activation_range())
+    // limits the refill to the first columns, e.g. for a partial N tile.
+    void fill_from_activation(const ActivationType* act_row,
+                              std::size_t count = npos) noexcept {
+        fill_from_activation_strided(act_row, 1, count);
+    }
+
+    // Same, reading activation a from act[a * stride] (e.g. one k of
+    // token-major N × K activations, stride = K)
+    void fill_from_activation_strided(const ActivationType* act, std::size_t stride,
+                                      std::size_t count = npos) noexcept {
         fill_impl([&](std::size_t a) -> int64_t {
-            int64_t raw = static_cast<int64_t>(act_row[a]);
+            int64_t raw = static_cast<int64_t>(act[a * stride]);
             if constexpr (std::is_same<ActivationType, uint8_t>::value) {
                 // two's-complement mapping for 4-bit
                 raw = (raw < static_cast<int64_t>(weight_levels_ / 2))
                       ? raw : (raw - static_cast<int64_t>(weight_levels_));
             }
             return raw;
-        });
+        }, count);
+    }
+
+    // Refill LUT from a callable a -> activation value; lets kernels fuse
+    // activation conversion (e.g. dynamic quantization) into the table build.
+    template<typename GetAct>
+    void fill_from_generator(GetAct get_act, std::size_t count = npos) noexcept {
+        fill_impl(get_act, count);
     }
 
+    // In mirror mode the returned row holds |w|·a; negate when is_negative(w).
     inline const P* get_row(std::size_t w) const noexcept {
-        return &table_[w * padded_a_range_];
+        return &table_[stored_row(w) * padded_a_range_];
     }
     inline ProductType get(std::size_t w, std::size_t a) const noexcept {
-        return table_[w * padded_a_range_ + a];
+        P v = table_[stored_row(w) * padded_a_range_ + a];
+        return (mirror_ && is_negative(w)) ? static_cast<P>(-v) : v;
     }
     inline ProductType operator()(std::size_t w, std::size_t a) const noexcept {
         return get(w, a);
@@ -100,9 +90,23 @@ public:
     std::size_t weight_levels() const noexcept { return weight_levels_; }
     std::size_t activation_range() const noexcept { return a_range_; }
     std::size_t lut_size_bytes() const noexcept { return table_.size() * sizeof(P); }
+    bool mirrored() const noexcept { return mirror_; }
+    std::size_t stored_rows() const noexcept { return stored_rows_; }
+
+    // Physical row holding weight index w (its magnitude in mirror mode)
+    inline std::size_t stored_row(std::size_t w) const noexcept {
+        if (!mirror_) return w;
+        return (w < weight_levels_ / 2) ? w : weight_levels_ - w;
+    }
+    // True when index w encodes a negative two's-complement weight
+    inline bool is_negative(std::size_t w) const noexcept {
+        return w >= weight_levels_ / 2;
+    }
 
 private:
     std::size_t weight_levels_, a_range_, padded_a_range_;
+    bool mirror_;
+    std::size_t stored_rows_;
     std::vector<P, AlignedAllocator<P, 64>> table_;
 
     // Multiply and saturate in product type range
@@ -113,19 +117,57 @@ private:
         return static_cast<P>(prod);
     }
 
-    // Core fill logic: computes table entries by combining signed weight and activation
+    // Core fill logic: computes table entries by combining signed weight and activation.
+    // In mirror mode stored row w is the magnitude w itself (0 … weight_levels/2).
+    // Each activation is fetched once and written down its column.
     template<typename GetAct>
-    void fill_impl(GetAct get_act) noexcept {
-        for (std::size_t w = 0; w < weight_levels_; ++w) {
-            int64_t signed_w = (w < weight_levels_ / 2)
-                            ? static_cast<int64_t>(w)
-                            : static_cast<int64_t>(w) - static_cast<int64_t>(weight_levels_);
-            P* row_ptr = &table_[w * padded_a_range_];
-            for (std::size_t a = 0; a < a_range_; ++a) {
-                int64_t act = get_act(a);
-                row_ptr[a] = compute_prod(signed_w, act);
+    void fill_impl(GetAct get_act, std::size_t count = npos) noexcept {
+        const std::size_t n = count < a_range_ ? count : a_range_;
+        for (std::size_t a = 0; a < n; ++a) {
+            int64_t act = get_act(a);
+            P* col_ptr = &table_[a];
+            for (std::size_t w = 0; w < stored_rows_; ++w) {
+                int64_t signed_w = (mirror_ || w < weight_levels_ / 2)
+                                ? static_cast<int64_t>(w)
+                                : static_cast<int64_t>(w) - static_cast<int64_t>(weight_levels_);
+                col_ptr[w * padded_a_range_] = compute_prod(signed_w, act);
             }
-            // padding intentionally left uninitialized for performance
         }
+        // padding intentionally left uninitialized for performance
+    }
+};
+
+// Float table for codebook (non-uniform 4-bit) weights:
+//   row c = codebook[c] · act[0 … width)
+// Rebuilt per activation row, like ProductLookupTable, but the 16
+// weight values come from the caller's codebook instead of the
+// two's-complement grid.
+class CodebookLookupTable {
+public:
+    static constexpr std::size_t kEntries = 16;
+
+    explicit CodebookLookupTable(std::size_t width)
+        : width_(width),
+          stride_(((width + 15) / 16) * 16),
+          table_(kEntries * stride_) {}
+
+    // count ≤ width(): number of activation columns to fill
+    void fill(const float* codebook, const float* act, std::size_t count) noexcept {
+        const std::size_t n = count < width_ ? count : width_;
+        for (std::size_t c = 0; c < kEntries; ++c) {
+            float* row = &table_[c * stride_];
+            const float cv = codebook[c];
+            for (std::size_t j = 0; j < n; ++j) row[j] = cv * act[j];
+        }
+    }
+
+    inline const float* get_row(std::size_t code) const noexcept {
+        return &table_[code * stride_];
     }
+    std::size_t width() const noexcept { return width_; }
+    std::size_t lut_size_bytes() const noexcept { return table_.size() * sizeof(float); }
+
+private:
+    std::size_t width_, stride_;
+    std::vector<float, AlignedAllocator<float, 64>> table_;
 };
@@ -3,6 +3,9 @@
 #include <cstddef>
 #include "layout_policies.hpp"
 #include "storage_policies.hpp"
+#include "huge_pages.hpp"
+
+template<typename E> struct MatExpr;   // lazy element-wise expressions, post_processing.hpp
 
 template<
     typename T,                              // logical element type
@@ -22,6 +25,22 @@ public:
         data_.resize(total_units);
     }
 
+    // Evaluates a lazy expression in one pass (see post_processing.hpp)
+    template<typename E>
+    Matrix(const MatExpr<E>& e)
+      : Matrix(e.self().rows(), e.self().cols())
+    {
+        assign_expr(e.self());
+    }
+
+    template<typename E>
+    Matrix& operator=(const MatExpr<E>& e) {
+        if (rows_ != e.self().rows() || cols_ != e.self().cols())
+            *this = Matrix(e.self().rows(), e.self().cols());
+        assign_expr(e.self());
+        return *this;
+    }
+
     /* ------------ element access ------------ */
     T at(size_t r, size_t c) const {
         size_t lin = LayoutPolicy::index(r, c, rows_, cols_);
@@ -62,6 +81,8 @@ public:
 
 
 private:
+    template<typename E> void assign_expr(const E& e);   // defined in post_processing.hpp
+
     size_t rows_, cols_;
-    std::vector<StorageType> data_;
+    std::vector<StorageType, AlignedAllocator<StorageType, 64>> data_;   // huge pages if enabled
 };
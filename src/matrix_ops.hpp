@@ -3,12 +3,19 @@
 #include "layout_policies.hpp"
 #include "storage_policies.hpp"
 #include "lut_utils.hpp"
+#include "lut_kernels.hpp"
+#include "quant_utils.hpp"
+#include "numa_utils.hpp"
+#include "tile_scheduler.hpp"
 #include <type_traits>
 #include <vector>
 #include <immintrin.h>
 #include <thread>
 #include <mutex>
 #include <iostream>
+#include <algorithm>
+#include <memory>
+#include <stdexcept>
 
 // =============================================================
 //  Helper: unpack a Matrix<> that uses Int4Storage into a
@@ -31,9 +38,53 @@ std::vector<uint8_t> unpack_int4(const Mat4& M)
     return out;
 }
 
+// =============================================================
+//  Split-K support
+//  When M is smaller than the thread count, row striping leaves
+//  threads idle (batch-1 decode, down-projections with huge K).
+//  Threads then own contiguous K-slices, accumulate private
+//  M × N partials, and combine them with a pairwise tree
+//  reduction whose pairing is fixed — results are bit-identical
+//  from run to run, also for floating point.
+// =============================================================
+
+// Number of K-slices to use; 1 keeps the row-parallel path
+inline size_t choose_k_splits(size_t M, size_t K, size_t num_threads,
+                              size_t min_k_per_split = 128)
+{
+    if (num_threads <= 1 || M >= num_threads) return 1;
+    size_t by_k = K / min_k_per_split;
+    return std::max<size_t>(1, std::min(num_threads, by_k));
+}
+
+namespace detail {
+
+// parts[0] += parts[1] + … in a fixed binary tree; levels run in parallel
+template<typename T>
+void tree_reduce(std::vector<std::vector<T>>& parts)
+{
+    const size_t P = parts.size();
+    TraceScope span("merge", "splitk", "parts", int64_t(P));
+    for (size_t stride = 1; stride < P; stride *= 2) {
+        std::vector<std::thread> threads;
+        for (size_t p = 0; p + stride < P; p += 2 * stride) {
+            threads.emplace_back([&, p, stride]() {
+                T* dst = parts[p].data();
+                const T* src = parts[p + stride].data();
+                const size_t len = parts[p].size();
+                for (size_t i = 0; i < len; ++i) dst[i] += src[i];
+            });
+        }
+        for (auto& thr : threads) thr.join();
+    }
+}
+
+} // namespace detail
+
 // =============================================================
 //  High-performance parallel GEMM implementation
 //  Supports any numeric type through templates
+//  2D-tiled by default; split-K when choose_k_splits() > 1.
 // =============================================================
 
 template<typename MA, typename MB>
@@ -46,39 +97,96 @@ auto matmul(const MA& A, const MB& B, size_t num_threads = 4)
     Matrix<T, RowMajor, PlainStorage<T>> C(M, N);
     std::vector<std::thread> threads;
 
-    size_t rows_per_thread = (M + num_threads - 1) / num_threads;
+    const size_t splits = choose_k_splits(M, K, num_threads);
+    if (splits > 1) {
+        std::vector<std::vector<T>> parts(splits, std::vector<T>(M * N, T(0)));
+        for (size_t t = 0; t < splits; ++t) {
+            threads.emplace_back([&, t]() {
+                maybe_pin_worker(t);
+                size_t k0 = K * t / splits, k1 = K * (t + 1) / splits;
+                TraceScope span("k_slice", "splitk", "k0", int64_t(k0), "k1", int64_t(k1));
+                T* part = parts[t].data();
+                for (size_t i = 0; i < M; ++i)
+                    for (size_t k = k0; k < k1; ++k) {
+                        T a = A.at(i, k);
+                        for (size_t j = 0; j < N; ++j)
+                            part[i * N + j] += a * B.at(k, j);
+                    }
+            });
+        }
+        for (auto& thread : threads) thread.join();
+        detail::tree_reduce(parts);
+        std::copy(parts[0].begin(), parts[0].end(), C.data());
+        return C;
+    }
+
+    // output tiles are disjoint, so workers write C directly
+    parallel_for_tiles(M, N, choose_tile_shape(M, N, num_threads), num_threads,
+                       [&](const Tile& tile) {
+        for (size_t i = tile.m0; i < tile.m1; ++i)
+            for (size_t k = 0; k < K; ++k) {
+                T a = A.at(i, k);
+                for (size_t j = tile.n0; j < tile.n1; ++j)
+                    C.set(i, j, C.at(i, j) + a * B.at(k, j));
+            }
+    });
+    return C;
+}
 
-    for (size_t t = 0; t < num_threads; ++t) {
-        threads.emplace_back([&, t]() {
-            size_t start_row = t * rows_per_thread;
-            size_t end_row = std::min(start_row + rows_per_thread, M);
+// =============================================================
+//  Blocked float GEMM on raw row-major buffers
+//  * A shape: M × K (K × M with trans.w)
+//  * B shape: K × N (N × K with trans.a, computed as dot products)
+//  * C shape: M × N (overwritten)
+//  Workers claim MC × NC output tiles; K is blocked so each B panel
+//  stays in cache while it is reused across the tile's rows.
+// =============================================================
 
-            Matrix<T, RowMajor, PlainStorage<T>> local_C(M, N);
+inline void matmul_f32_blocked(const float* A, const float* B, float* C,
+                               size_t M, size_t K, size_t N,
+                               size_t num_threads = 4,
+                               Transpose trans = {})
+{
+    constexpr size_t KC = 256;
+    std::fill(C, C + M * N, 0.0f);
+    const TileShape shape = choose_tile_shape(M, N, num_threads, {64, 512});
+    const Strides sa = trans.w_strides(M, K);
 
-            for (size_t i = start_row; i < end_row; ++i) {
-                for (size_t k = 0; k < K; ++k) {
-                    T a = A.at(i, k);
-                    for (size_t j = 0; j < N; ++j) {
-                        local_C.set(i, j, local_C.at(i, j) + a * B.at(k, j));
+    if (trans.a) {
+        // B is N × K: each output is a K-contiguous dot product
+        parallel_for_tiles(M, N, shape, num_threads, [&](const Tile& tile) {
+            for (size_t i = tile.m0; i < tile.m1; ++i) {
+                const float* a_row = A + sa(i, 0);
+                for (size_t j = tile.n0; j < tile.n1; ++j) {
+                    const float* b_col = B + j * K;
+                    float sum = 0.0f;
+                    if (sa.col == 1) {
+#pragma omp simd reduction(+:sum)
+                        for (size_t k = 0; k < K; ++k) sum += a_row[k] * b_col[k];
+                    } else {
+                        for (size_t k = 0; k < K; ++k) sum += a_row[k * sa.col] * b_col[k];
                     }
-                }
-            }
-
-            static std::mutex mtx;
-            std::lock_guard<std::mutex> lock(mtx);
-            for (size_t i = start_row; i < end_row; ++i) {
-                for (size_t j = 0; j < N; ++j) {
-                    C.set(i, j, C.at(i, j) + local_C.at(i, j));
+                    C[i * N + j] = sum;
                 }
             }
         });
+        return;
     }
 
-    for (auto& thread : threads) {
-        thread.join();
-    }
-
-    return C;
+    parallel_for_tiles(M, N, shape, num_threads, [&](const Tile& tile) {
+        for (size_t k0 = 0; k0 < K; k0 += KC) {
+            size_t k1 = std::min(k0 + KC, K);
+            for (size_t i = tile.m0; i < tile.m1; ++i) {
+                float* c_row = C + i * N;
+                for (size_t k = k0; k < k1; ++k) {
+                    float a = A[sa(i, k)];
+                    const float* b_row = B + k * N;
+                    for (size_t j = tile.n0; j < tile.n1; ++j)
+                        c_row[j] += a * b_row[j];
+                }
+            }
+        }
+    });
 }
 
 // =============================================================
@@ -126,58 +234,526 @@ Matrix<T> matmul_mkl(const Matrix<T>& A, const Matrix<T>& B) {
 
 // =============================================================
 //  High‑speed LUT GEMM — expects *unpacked* uint8 buffers.
-//  * Au shape: M × K  contiguous
-//  * Bu shape: K × N  contiguous
+//  * Au shape: M × K  contiguous (K × M with trans.w)
+//  * Bu shape: K × N  contiguous (N × K with trans.a)
 //  Works with or without AVX2 (scalar fallback).
+//  `lut` supplies the table configuration (weight levels, mirror
+//  mode); every worker fills its own tile-wide table per activation
+//  row, so the caller's table is never written concurrently.
+//  In mirror mode only |w| rows are built and the sign is applied
+//  while accumulating, halving table size and fill cost.
 // =============================================================
 
-// LUT-based mixed-precision GEMM kernel
+namespace detail {
+
+// One weight row band multiplied against a shared activation panel:
+// W(r, k) = W[ws(r, k)], output rows C + r * ldc, r < rows.
+struct LutBand {
+    const uint8_t* W;
+    Strides ws;
+    int32_t* C;
+    size_t ldc;
+    size_t rows;
+};
+
+// LUT accumulation for several row bands sharing one activation panel:
+//   C_b[r][:cols] += Σ_k lut(W_b(r, k), A(k, :cols))   for every band b
+// A_mat points at the panel origin and `as` gives the element strides
+// of A (K × cols), so transposed operands are read in place. For each
+// row block of `block_size` rows, tables for panel.depth() consecutive
+// k are built once and then multiplied against every band by the
+// register-tile micro-kernel (see lut_kernels.hpp). The panel's
+// tables must be at least `cols` wide.
+template <typename A>
+void lut_accumulate_bands(const LutBand* bands, size_t num_bands,
+                          const A* A_mat, Strides as,
+                          size_t K, size_t cols,
+                          LutPanel<A>& panel,
+                          size_t block_size)
+{
+    const bool mirror = panel.mirrored();
+    const unsigned levels = unsigned(panel.weight_levels());
+    const size_t ld = panel.row_stride(), depth = panel.depth();
+    const LutMicroKernel* uk = select_lut_micro_kernel<int32_t>(levels, cols);
+    const size_t mr = uk ? size_t(uk->mr) : 0, nr = uk ? size_t(uk->nr) : 0;
+    const size_t cols_full = uk ? cols / nr * nr : 0;
+
+    size_t rows = 0;
+    for (size_t b = 0; b < num_bands; ++b) rows = std::max(rows, bands[b].rows);
+    for (size_t i = 0; i < rows; i += block_size) {
+        size_t i_end = std::min(i + block_size, rows);
+        for (size_t k = 0; k < K; k += depth) {
+            const size_t kc = std::min(depth, K - k);
+            {
+                TraceScope span("lut_build", "lut", "k0", int64_t(k), "k1", int64_t(k + kc));
+                for (size_t kk = 0; kk < kc; ++kk) {
+                    const A* a = A_mat + (k + kk) * as.row;
+                    if (as.col == 1) panel.table(kk).fill_from_activation(a, cols);
+                    else             panel.table(kk).fill_from_activation_strided(a, as.col, cols);
+                }
+            }
+            for (size_t b = 0; b < num_bands; ++b) {
+                const LutBand& band = bands[b];
+                const size_t r_end = std::min(i_end, band.rows);
+                if (r_end <= i) continue;
+                const uint8_t* Wk = band.W + band.ws(0, k);
+                size_t r = i;
+                if (uk) {
+                    for (; r + mr <= r_end; r += mr)
+                        for (size_t j = 0; j < cols_full; j += nr)
+                            uk->fn(Wk + band.ws(r, 0), band.ws, panel.tables(), ld, j, kc, mirror,
+                                   band.C + r * band.ldc + j, band.ldc);
+                    if (cols_full < cols)   // column remainder of the full row blocks
+                        lut_micro_edge(Wk + band.ws(i, 0), band.ws, panel.tables(), ld, kc,
+                                       levels, mirror, band.C + i * band.ldc + cols_full,
+                                       band.ldc, r - i, cols_full, cols - cols_full);
+                }
+                if (r < r_end)              // row remainder, all columns
+                    lut_micro_edge(Wk + band.ws(r, 0), band.ws, panel.tables(), ld, kc,
+                                   levels, mirror, band.C + r * band.ldc, band.ldc,
+                                   r_end - r, 0, cols);
+            }
+        }
+    }
+}
+
+// LUT accumulation for a single rows × cols tile (W_rows, C_rows at
+// the tile origin; ws gives the element strides of W, rows × K)
 template <typename A>
-auto matmul_lut_fast(const std::vector<uint8_t>& W,
-                     const std::vector<A>& A_mat,
+void lut_accumulate_tile(const uint8_t* W_rows, Strides ws,
+                         const A* A_mat, Strides as,
+                         int32_t* C_rows, size_t ldc,
+                         size_t rows, size_t K, size_t cols,
+                         LutPanel<A>& panel,
+                         size_t block_size)
+{
+    const LutBand band{W_rows, ws, C_rows, ldc, rows};
+    lut_accumulate_bands(&band, 1, A_mat, as, K, cols, panel, block_size);
+}
+
+} // namespace detail
+
+// LUT-based mixed-precision GEMM kernel
+template <typename A, typename WAlloc, typename AAlloc>
+auto matmul_lut_fast(const std::vector<uint8_t, WAlloc>& W,
+                     const std::vector<A, AAlloc>& A_mat,
                      size_t M, size_t K, size_t N,
-                     ProductLookupTable<uint8_t, A, int32_t>& lut,
+                     const ProductLookupTable<uint8_t, A, int32_t>& lut,
                      size_t block_size = 64,
-                     size_t num_threads = 4) {
+                     size_t num_threads = 4,
+                     Transpose trans = {}) {
     // Result matrix
     Matrix<int32_t, RowMajor, PlainStorage<int32_t>> C(M, N);
+    int32_t* Cd = C.data();
+    const size_t levels = lut.weight_levels();
+    const bool mirror = lut.mirrored();
+    const Strides ws = trans.w_strides(M, K), as = trans.a_strides(K, N);
     std::vector<std::thread> threads;
-    std::mutex mtx;
-    size_t rows_per_thread = (M + num_threads - 1) / num_threads;
-
-    for (size_t t = 0; t < num_threads; ++t) {
-        threads.emplace_back([&, t]() {
-            size_t row_start = t * rows_per_thread;
-            size_t row_end = std::min(row_start + rows_per_thread, M);
-            Matrix<int32_t, RowMajor, PlainStorage<int32_t>> localC(M, N);
-            for (size_t i = row_start; i < row_end; i += block_size) {
-                size_t i_end = std::min(i + block_size, row_end);
-                for (size_t k = 0; k < K; k += block_size) {
-                    size_t k_end = std::min(k + block_size, K);
-                    // For each k in this block, rebuild LUT and accumulate
-                    for (size_t kk = k; kk < k_end; ++kk) {
-                        const A* act_row = &A_mat[kk * N];
-                        lut.fill_from_activation(act_row);
-                        // Accumulate for each row i
-                        for (size_t ii = i; ii < i_end; ++ii) {
-                            uint8_t q = W[ii * K + kk];
-                            const int32_t* lut_row = lut.get_row(q);
-                            for (size_t j = 0; j < N; ++j) {
-                                localC.set(ii, j, localC.at(ii, j) + lut_row[j]);
-                            }
-                        }
+
+    const size_t splits = choose_k_splits(M, K, num_threads);
+    if (splits > 1) {
+        // split-K: each worker covers all M rows for its K-slice
+        std::vector<std::vector<int32_t>> parts(splits, std::vector<int32_t>(M * N, 0));
+        for (size_t t = 0; t < splits; ++t) {
+            threads.emplace_back([&, t]() {
+                maybe_pin_worker(t);
+                size_t k0 = K * t / splits, k1 = K * (t + 1) / splits;
+                TraceScope span("k_slice", "splitk", "k0", int64_t(k0), "k1", int64_t(k1));
+                detail::LutPanel<A> local(levels, N, mirror);
+                detail::lut_accumulate_tile(&W[ws(0, k0)], ws, &A_mat[as(k0, 0)], as,
+                                            parts[t].data(), N, M, k1 - k0, N,
+                                            local, block_size);
+            });
+        }
+        for (auto& thr : threads) thr.join();
+        detail::tree_reduce(parts);
+        std::copy(parts[0].begin(), parts[0].end(), Cd);
+        return C;
+    }
+
+    // 2D tiles; each worker's table is one tile (NC) wide
+    const TileShape shape = choose_tile_shape(M, N, num_threads, {128, 256}, 64);
+    parallel_for_tiles(M, N, shape, num_threads,
+        [&](size_t) {
+            return detail::LutPanel<A>(levels, std::min(shape.nc, N), mirror);
+        },
+        [&](const Tile& tile, detail::LutPanel<A>& local) {
+            detail::lut_accumulate_tile(&W[ws(tile.m0, 0)], ws,
+                                        &A_mat[as(0, tile.n0)], as,
+                                        Cd + tile.m0 * N + tile.n0, N,
+                                        tile.rows(), K, tile.cols(), local, block_size);
+        });
+    return C;
+}
+
+// =============================================================
+//  Multi-weight LUT GEMM — several weight matrices (e.g. fused
+//  Q/K/V or gate/up projections) times one shared activation.
+//  * Ws[w] shape: Ms[w] × K unpacked nibbles (K × Ms[w] with trans.w)
+//  * A_mat shape: K × N (N × K with trans.a)
+//  Returns one M_w × N result per weight. Tiles span the same row
+//  band of every weight, so each activation table is filled once
+//  and streamed against all of them instead of once per matrix.
+// =============================================================
+
+template <typename A, typename AAlloc>
+auto matmul_lut_multi(const std::vector<const uint8_t*>& Ws,
+                      const std::vector<size_t>& Ms,
+                      const std::vector<A, AAlloc>& A_mat,
+                      size_t K, size_t N,
+                      const ProductLookupTable<uint8_t, A, int32_t>& lut,
+                      size_t block_size = 64,
+                      size_t num_threads = 4,
+                      Transpose trans = {}) {
+    using Result = Matrix<int32_t, RowMajor, PlainStorage<int32_t>>;
+    if (Ws.size() != Ms.size())
+        throw std::invalid_argument("matmul_lut_multi: one row count per weight matrix");
+    const size_t nw = Ws.size();
+    std::vector<Result> C;
+    C.reserve(nw);
+    size_t max_m = 0, total_m = 0;
+    for (size_t w = 0; w < nw; ++w) {
+        C.emplace_back(Ms[w], N);
+        max_m = std::max(max_m, Ms[w]);
+        total_m += Ms[w];
+    }
+    if (nw == 0) return C;
+    const size_t levels = lut.weight_levels();
+    const bool mirror = lut.mirrored();
+    const Strides as = trans.a_strides(K, N);
+    auto w_strides = [&](size_t w) { return trans.w_strides(Ms[w], K); };
+
+    const size_t splits = choose_k_splits(total_m, K, num_threads);
+    if (splits > 1) {
+        // split-K over all weights at once; partials are stacked by weight
+        std::vector<std::vector<int32_t>> parts(splits, std::vector<int32_t>(total_m * N, 0));
+        std::vector<std::thread> threads;
+        for (size_t t = 0; t < splits; ++t) {
+            threads.emplace_back([&, t]() {
+                maybe_pin_worker(t);
+                size_t k0 = K * t / splits, k1 = K * (t + 1) / splits;
+                TraceScope span("k_slice", "splitk", "k0", int64_t(k0), "k1", int64_t(k1));
+                detail::LutPanel<A> local(levels, N, mirror);
+                std::vector<detail::LutBand> bands;
+                size_t row0 = 0;
+                for (size_t w = 0; w < nw; ++w) {
+                    const Strides ws = w_strides(w);
+                    bands.push_back({Ws[w] + ws(0, k0), ws, parts[t].data() + row0 * N, N, Ms[w]});
+                    row0 += Ms[w];
+                }
+                detail::lut_accumulate_bands(bands.data(), nw, &A_mat[as(k0, 0)], as,
+                                             k1 - k0, N, local, block_size);
+            });
+        }
+        for (auto& thr : threads) thr.join();
+        detail::tree_reduce(parts);
+        size_t row0 = 0;
+        for (size_t w = 0; w < nw; ++w) {
+            std::copy_n(parts[0].begin() + row0 * N, Ms[w] * N, C[w].data());
+            row0 += Ms[w];
+        }
+        return C;
+    }
+
+    const TileShape shape = choose_tile_shape(max_m, N, num_threads, {128, 256}, 64);
+    parallel_for_tiles(max_m, N, shape, num_threads,
+        [&](size_t) {
+            return detail::LutPanel<A>(levels, std::min(shape.nc, N), mirror);
+        },
+        [&](const Tile& tile, detail::LutPanel<A>& local) {
+            std::vector<detail::LutBand> bands;
+            bands.reserve(nw);
+            for (size_t w = 0; w < nw; ++w) {
+                if (tile.m0 >= Ms[w]) continue;   // shorter matrix: band is past its end
+                const Strides ws = w_strides(w);
+                bands.push_back({Ws[w] + ws(tile.m0, 0), ws, C[w].data() + tile.m0 * N + tile.n0,
+                                 N, std::min(tile.m1, Ms[w]) - tile.m0});
+            }
+            detail::lut_accumulate_bands(bands.data(), bands.size(), &A_mat[as(0, tile.n0)], as,
+                                         K, tile.cols(), local, block_size);
+        });
+    return C;
+}
+
+// =============================================================
+//  NUMA-aware LUT GEMM — same contract as matmul_lut_fast, but
+//  weights come pre-split into node-local row slices. Workers are
+//  divided among nodes in proportion to their slice, pinned to
+//  that node's CPUs, and only claim tiles whose weights live there.
+// =============================================================
+
+template <typename A, typename AAlloc>
+auto matmul_lut_numa(const NumaWeights& W,
+                     const std::vector<A, AAlloc>& A_mat,
+                     size_t N,
+                     const ProductLookupTable<uint8_t, A, int32_t>& lut,
+                     size_t block_size = 64,
+                     size_t num_threads = 4,
+                     const NumaTopology& topo = numa_topology(),
+                     Transpose trans = {}) {
+    const size_t M = W.rows(), K = W.cols();
+    if (trans.w) throw std::invalid_argument("matmul_lut_numa: NumaWeights are row-major");
+    const Strides as = trans.a_strides(K, N);
+    Matrix<int32_t, RowMajor, PlainStorage<int32_t>> C(M, N);
+    int32_t* Cd = C.data();
+    const size_t levels = lut.weight_levels();
+    const bool mirror = lut.mirrored();
+    std::vector<std::thread> threads;
+
+    // each node's workers pull tiles of its own slice from a shared scheduler
+    const auto& slices = W.slices();
+    std::vector<std::unique_ptr<TileScheduler>> scheds(slices.size());
+    size_t assigned = 0;
+    for (size_t s = 0; s < slices.size(); ++s) {
+        const auto& slice = slices[s];
+        if (slice.rows == 0) continue;
+        // workers for this node ∝ its share of rows (at least one)
+        size_t target = (s + 1 == slices.size())
+                      ? num_threads
+                      : num_threads * (slice.row_begin + slice.rows) / M;
+        size_t share = target > assigned ? target - assigned : 1;
+        assigned += share;
+        const auto& cpus = topo.node_cpus[slice.node_index];
+        scheds[s] = std::make_unique<TileScheduler>(
+            slice.rows, N, choose_tile_shape(slice.rows, N, share, {128, 256}, 64));
+        TileScheduler& sched = *scheds[s];
+
+        for (size_t w = 0; w < share; ++w) {
+            threads.emplace_back([&, w]() {
+                pin_current_thread(cpus[w % cpus.size()]);
+                detail::LutPanel<A> local(
+                    levels, std::min(sched.shape().nc, N), mirror);
+                Tile tile;
+                while (sched.next(tile)) {
+                    detail::lut_accumulate_tile(slice.data() + tile.m0 * K, Strides{K, 1},
+                                                &A_mat[as(0, tile.n0)], as,
+                                                Cd + (slice.row_begin + tile.m0) * N + tile.n0, N,
+                                                tile.rows(), K, tile.cols(), local, block_size);
+                }
+            });
+        }
+    }
+    for (auto& thr : threads) thr.join();
+    return C;
+}
+
+// =============================================================
+//  Codebook LUT GEMM — non-uniform 4-bit weights (NF4 / fitted
+//  codebooks, see quantize_codebook) × float activations.
+//  * W: CodebookWeights, M × K indices + one codebook per row group
+//  * A shape: K × N  float
+//  * C shape: M × N  float, overwritten
+//  Per activation row the worker builds codebook × activation for
+//  the tile's columns once per row group and accumulates table
+//  rows by index for every row of the group. A build is 16 × cols
+//  multiplies against group_rows × cols adds, so it is amortized
+//  only when groups are well above 16 rows (kCodebookGroupRows =
+//  64 by default); one codebook per row rebuilds the table for
+//  every row and k, 16 multiplies per accumulated element.
+// =============================================================
+
+inline void matmul_lut_codebook(const CodebookWeights& W, const float* A, float* C,
+                                size_t N, size_t num_threads = 4)
+{
+    const size_t M = W.rows, K = W.cols, G = W.group_rows;
+    std::fill(C, C + M * N, 0.0f);
+    const TileShape shape = choose_tile_shape(M, N, num_threads, {128, 256}, 64);
+
+    parallel_for_tiles(M, N, shape, num_threads,
+        [&](size_t) { return CodebookLookupTable(std::min(shape.nc, N)); },
+        [&](const Tile& tile, CodebookLookupTable& lut) {
+            const size_t cols = tile.cols();
+            for (size_t g0 = tile.m0; g0 < tile.m1; ) {
+                size_t g1 = std::min(tile.m1, (g0 / G + 1) * G);   // rows sharing a codebook
+                const float* cb = W.codebook_of_row(g0);
+                for (size_t k = 0; k < K; ++k) {
+                    lut.fill(cb, A + k * N + tile.n0, cols);
+                    for (size_t i = g0; i < g1; ++i) {
+                        const float* lut_row = lut.get_row(W.codes[i * K + k]);
+                        float* c_row = C + i * N + tile.n0;
+                        for (size_t j = 0; j < cols; ++j) c_row[j] += lut_row[j];
                     }
                 }
+                g0 = g1;
             }
-            // Merge into C
-            std::lock_guard<std::mutex> lock(mtx);
-            for (size_t ii = row_start; ii < row_end; ++ii) {
-                for (size_t j = 0; j < N; ++j) {
-                    C.set(ii, j, C.at(ii, j) + localC.at(ii, j));
+        });
+}
+
+// =============================================================
+//  W4A8 GEMM — int4 weights × dynamically quantized int8
+//  activations, float output.
+//  * W shape: M × K  unpacked nibbles (0‥15, two's complement);
+//                    K × M with trans.w
+//  * A shape: K × N  float or fp16_t, one token per column;
+//                    N × K (token-major) with trans.a
+//  * C shape: M × N  float or fp16_t, overwritten
+//  Half activations are widened one row (or tile row) at a time
+//  into a small cache-resident scratch, never as a full copy.
+//  Each token j is quantized with its own scale s_j; the epilogue
+//  rescales by s_j (and by w_scales[i] when given).
+//  Two interchangeable inner paths:
+//  * LUT — quantization is fused into the per-row table build
+//  * Dot — AVX2 maddubs int4×int8 dot products over K
+//  Auto picks Dot when the CPU reports AVX2 at runtime.
+// =============================================================
+
+enum class W4A8Path { Auto, LUT, Dot };
+
+namespace detail {
+
+inline int8_t int4_to_int8(uint8_t q) {
+    return static_cast<int8_t>(q < 8 ? q : int(q) - 16);
+}
+
+// Scalar int4 × int8 dot products for the tile's rows × columns
+inline void w4a8_dot_tile_scalar(const int8_t* Wi, const int8_t* At,
+                                 int32_t* acc, const Tile& tile,
+                                 size_t Kp, size_t N) {
+    for (size_t i = tile.m0; i < tile.m1; ++i) {
+        const int8_t* w = Wi + i * Kp;
+        for (size_t j = tile.n0; j < tile.n1; ++j) {
+            const int8_t* a = At + j * Kp;
+            int32_t s = 0;
+            for (size_t k = 0; k < Kp; ++k) s += int32_t(w[k]) * int32_t(a[k]);
+            acc[i * N + j] = s;
+        }
+    }
+}
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+// AVX2 int4 × int8 dot products: |w| (u8) × sign(a, w) (s8) via maddubs.
+// |w| ≤ 8 and |a| ≤ 127, so the pairwise int16 sums cannot saturate.
+__attribute__((target("avx2")))
+inline void w4a8_dot_tile_avx2(const int8_t* Wi, const int8_t* At,
+                               int32_t* acc, const Tile& tile,
+                               size_t Kp, size_t N) {
+    const __m256i ones = _mm256_set1_epi16(1);
+    for (size_t i = tile.m0; i < tile.m1; ++i) {
+        const int8_t* w = Wi + i * Kp;
+        for (size_t j = tile.n0; j < tile.n1; ++j) {
+            const int8_t* a = At + j * Kp;
+            __m256i vacc = _mm256_setzero_si256();
+            for (size_t k = 0; k < Kp; k += 32) {
+                __m256i wv = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(w + k));
+                __m256i av = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(a + k));
+                __m256i p16 = _mm256_maddubs_epi16(_mm256_abs_epi8(wv),
+                                                   _mm256_sign_epi8(av, wv));
+                vacc = _mm256_add_epi32(vacc, _mm256_madd_epi16(p16, ones));
+            }
+            __m128i s = _mm_add_epi32(_mm256_castsi256_si128(vacc),
+                                      _mm256_extracti128_si256(vacc, 1));
+            s = _mm_add_epi32(s, _mm_shuffle_epi32(s, 0x4E));
+            s = _mm_add_epi32(s, _mm_shuffle_epi32(s, 0xB1));
+            acc[i * N + j] = _mm_cvtsi128_si32(s);
+        }
+    }
+}
+#endif
+
+} // namespace detail
+
+template<typename AT, typename CT>
+void matmul_w4a8(const uint8_t* W, const AT* A, CT* C,
+                 size_t M, size_t K, size_t N,
+                 const float* w_scales = nullptr,
+                 W4A8Path path = W4A8Path::Auto,
+                 size_t num_threads = 4,
+                 Transpose trans = {})
+{
+    if (path == W4A8Path::Auto)
+        path = cpu_has_avx2() ? W4A8Path::Dot : W4A8Path::LUT;
+    const Strides sw = trans.w_strides(M, K), sa = trans.a_strides(K, N);
+
+    std::vector<float> scales(N), inv_scales(N);
+    compute_token_scales_int8(A, K, N, scales.data(), trans.a);
+    for (size_t j = 0; j < N; ++j) inv_scales[j] = 1.0f / scales[j];
+
+    std::vector<int32_t> acc(M * N, 0);
+    const TileShape shape = path == W4A8Path::LUT
+                          ? choose_tile_shape(M, N, num_threads, {128, 256}, 64)
+                          : choose_tile_shape(M, N, num_threads);
+
+    if (path == W4A8Path::LUT) {
+        struct LutWorker {
+            ProductLookupTable<uint8_t, int8_t, int32_t> lut;
+            std::vector<float> scratch;   // one widened half row (fp16 input)
+            explicit LutWorker(size_t nc)
+              : lut(16, nc, true), scratch(std::is_same_v<AT, float> ? 0 : nc) {}
+        };
+        parallel_for_tiles(M, N, shape, num_threads,
+            [&](size_t) { return LutWorker(std::min(shape.nc, N)); },
+            [&](const Tile& tile, LutWorker& wk) {
+                auto& lut = wk.lut;
+                const size_t cols = tile.cols();
+                const float* inv = inv_scales.data() + tile.n0;
+                for (size_t k = 0; k < K; ++k) {
+                    // quantize-on-fill: the int8 row never hits memory
+                    if (trans.a) {   // token-major: gather one k across the tile's tokens
+                        const AT* a_col = A + sa(k, tile.n0);
+                        lut.fill_from_generator([&](size_t j) -> int64_t {
+                            return quantize_int8(detail::to_float(a_col[j * K]), inv[j]);
+                        }, cols);
+                    } else {
+                        const float* a_row = detail::row_as_float(A + sa(k, tile.n0),
+                                                                  cols, wk.scratch.data());
+                        lut.fill_from_generator([&](size_t j) -> int64_t {
+                            return quantize_int8(a_row[j], inv[j]);
+                        }, cols);
+                    }
+                    for (size_t i = tile.m0; i < tile.m1; ++i) {
+                        uint8_t q = W[sw(i, k)];
+                        const int32_t* lut_row = lut.get_row(q);
+                        int32_t* c_row = &acc[i * N + tile.n0];
+                        if (lut.is_negative(q)) {
+                            for (size_t j = 0; j < cols; ++j) c_row[j] -= lut_row[j];
+                        } else {
+                            for (size_t j = 0; j < cols; ++j) c_row[j] += lut_row[j];
+                        }
+                    }
                 }
+            });
+    } else {
+        // K-contiguous operands, zero-padded to a multiple of 32
+        const size_t Kp = (K + 31) / 32 * 32;
+        std::vector<int8_t> Wi(M * Kp, 0), At(N * Kp, 0);
+        for (size_t i = 0; i < M; ++i)
+            for (size_t k = 0; k < K; ++k)
+                Wi[i * Kp + k] = detail::int4_to_int8(W[sw(i, k)]);
+        if (trans.a) {
+            // token-major input already has the K-contiguous layout
+            std::vector<float> scratch(std::is_same_v<AT, float> ? 0 : K);
+            for (size_t j = 0; j < N; ++j) {
+                const float* tok = detail::row_as_float(A + j * K, K, scratch.data());
+                for (size_t k = 0; k < K; ++k)
+                    At[j * Kp + k] = quantize_int8(tok[k], inv_scales[j]);
             }
+        } else {
+            std::vector<float> scratch(std::is_same_v<AT, float> ? 0 : N);
+            for (size_t k = 0; k < K; ++k) {
+                const float* a_row = detail::row_as_float(A + k * N, N, scratch.data());
+                for (size_t j = 0; j < N; ++j)
+                    At[j * Kp + k] = quantize_int8(a_row[j], inv_scales[j]);
+            }
+        }
+
+        parallel_for_tiles(M, N, shape, num_threads, [&](const Tile& tile) {
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+            if (cpu_has_avx2()) {
+                detail::w4a8_dot_tile_avx2(Wi.data(), At.data(), acc.data(), tile, Kp, N);
+                return;
+            }
+#endif
+            detail::w4a8_dot_tile_scalar(Wi.data(), At.data(), acc.data(), tile, Kp, N);
         });
     }
-    for (auto& thr : threads) thr.join();
-    return C;
-}
\ No newline at end of file
+
+    // Epilogue: undo per-token (and optional per-row weight) scaling
+    // (written through a float row so half output is converted in bulk)
+    std::vector<float> out_row(N);
+    for (size_t i = 0; i < M; ++i) {
+        float ws = w_scales ? w_scales[i] : 1.0f;
+        for (size_t j = 0; j < N; ++j)
+            out_row[j] = float(acc[i * N + j]) * scales[j] * ws;
+        detail::store_row(out_row.data(), C + i * N, N);
+    }
+}
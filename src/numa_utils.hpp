@@ -0,0 +1,265 @@
+#pragma once
+#include <vector>
+#include <string>
+#include <fstream>
+#include <sstream>
+#include <thread>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <new>
+#include <algorithm>
+
+#ifdef __linux__
+#include <pthread.h>
+#include <sched.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+#ifdef USE_NUMA
+#include <numa.h>
+#endif
+
+// =============================================================
+//  NUMA helpers
+//  * topology from /sys/devices/system/node (no libnuma needed)
+//  * thread pinning via pthread_setaffinity_np
+//  * node-local buffers: libnuma when built with USE_NUMA=1,
+//    otherwise mmap + mbind(MPOL_PREFERRED) + first touch by a
+//    thread pinned to the node. Every step degrades to a plain
+//    allocation on systems without NUMA support.
+// =============================================================
+
+struct NumaTopology {
+    std::vector<int> node_ids;                 // kernel node numbers
+    std::vector<std::vector<int>> node_cpus;   // CPUs of each node
+
+    size_t num_nodes() const noexcept { return node_cpus.size(); }
+    size_t num_cpus() const noexcept {
+        size_t n = 0;
+        for (auto& c : node_cpus) n += c.size();
+        return n;
+    }
+    // CPUs in node-major order: the t-th worker runs on cpu_order()[t % n]
+    std::vector<int> cpu_order() const {
+        std::vector<int> out;
+        for (auto& c : node_cpus) out.insert(out.end(), c.begin(), c.end());
+        return out;
+    }
+};
+
+namespace detail {
+
+// Parses a kernel cpulist / nodelist such as "0-3,8-11"
+inline std::vector<int> parse_cpulist(const std::string& s) {
+    std::vector<int> cpus;
+    std::stringstream ss(s);
+    std::string part;
+    while (std::getline(ss, part, ',')) {
+        if (part.empty()) continue;
+        size_t dash = part.find('-');
+        int lo = std::stoi(part.substr(0, dash));
+        int hi = dash == std::string::npos ? lo : std::stoi(part.substr(dash + 1));
+        for (int c = lo; c <= hi; ++c) cpus.push_back(c);
+    }
+    return cpus;
+}
+
+inline std::string read_first_line(const std::string& path) {
+    std::ifstream f(path);
+    std::string line;
+    if (f) std::getline(f, line);
+    return line;
+}
+
+inline NumaTopology detect_topology() {
+    NumaTopology topo;
+#ifdef __linux__
+    const std::string base = "/sys/devices/system/node/";
+    for (int node : parse_cpulist(read_first_line(base + "online"))) {
+        auto cpus = parse_cpulist(
+            read_first_line(base + "node" + std::to_string(node) + "/cpulist"));
+        if (cpus.empty()) continue;              // memory-only node
+        topo.node_ids.push_back(node);
+        topo.node_cpus.push_back(std::move(cpus));
+    }
+#endif
+    if (topo.node_cpus.empty()) {
+        unsigned n = std::max(1u, std::thread::hardware_concurrency());
+        std::vector<int> all(n);
+        for (unsigned c = 0; c < n; ++c) all[c] = int(c);
+        topo.node_ids.push_back(0);
+        topo.node_cpus.push_back(std::move(all));
+    }
+    return topo;
+}
+
+inline std::atomic<bool>& pinning_flag() {
+    static std::atomic<bool> flag{false};
+    return flag;
+}
+
+} // namespace detail
+
+inline const NumaTopology& numa_topology() {
+    static const NumaTopology topo = detail::detect_topology();
+    return topo;
+}
+
+// Pins the calling thread to one CPU; returns false when unsupported
+inline bool pin_current_thread(int cpu) {
+#ifdef __linux__
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    CPU_SET(cpu, &set);
+    return pthread_setaffinity_np(pthread_self(), sizeof(set), &set) == 0;
+#else
+    (void)cpu;
+    return false;
+#endif
+}
+
+// Global switch read by the threaded kernels in matrix_ops.hpp:
+// when on, worker t pins itself to numa_topology().cpu_order()[t % ncpu].
+inline void set_thread_pinning(bool enable) { detail::pinning_flag() = enable; }
+inline bool thread_pinning_enabled() { return detail::pinning_flag().load(); }
+
+inline void maybe_pin_worker(size_t t) {
+    if (!thread_pinning_enabled()) return;
+    static const std::vector<int> order = numa_topology().cpu_order();
+    pin_current_thread(order[t % order.size()]);
+}
+
+// =============================================================
+//  NodeBuffer — bytes placed on one NUMA node (best effort)
+// =============================================================
+class NodeBuffer {
+public:
+    NodeBuffer() = default;
+    NodeBuffer(size_t bytes, int node) : bytes_(bytes), node_(node) {
+        if (bytes_ == 0) return;
+#ifdef USE_NUMA
+        if (numa_available() >= 0) {
+            ptr_ = numa_alloc_onnode(bytes_, node_);
+            if (ptr_) { kind_ = Kind::Libnuma; return; }
+        }
+#endif
+#ifdef __linux__
+        void* p = mmap(nullptr, bytes_, PROT_READ | PROT_WRITE,
+                       MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (p != MAP_FAILED) {
+            ptr_ = p;
+            kind_ = Kind::Mmap;
+#ifdef SYS_mbind
+            // MPOL_PREFERRED (1): fall back to other nodes when this one is full
+            if (node_ >= 0 && node_ < int(8 * sizeof(unsigned long))) {
+                unsigned long mask = 1UL << node_;
+                syscall(SYS_mbind, p, bytes_, 1, &mask, 8 * sizeof(mask) + 1, 0);
+            }
+#endif
+            return;
+        }
+#endif
+        ptr_ = ::operator new(bytes_);
+        kind_ = Kind::Heap;
+    }
+
+    NodeBuffer(const NodeBuffer&) = delete;
+    NodeBuffer& operator=(const NodeBuffer&) = delete;
+    NodeBuffer(NodeBuffer&& o) noexcept { *this = std::move(o); }
+    NodeBuffer& operator=(NodeBuffer&& o) noexcept {
+        if (this != &o) {
+            release();
+            ptr_ = o.ptr_; bytes_ = o.bytes_; node_ = o.node_; kind_ = o.kind_;
+            o.ptr_ = nullptr; o.bytes_ = 0; o.kind_ = Kind::None;
+        }
+        return *this;
+    }
+    ~NodeBuffer() { release(); }
+
+    void* data() noexcept { return ptr_; }
+    const void* data() const noexcept { return ptr_; }
+    size_t size() const noexcept { return bytes_; }
+    int node() const noexcept { return node_; }
+
+private:
+    enum class Kind { None, Libnuma, Mmap, Heap };
+    void* ptr_ = nullptr;
+    size_t bytes_ = 0;
+    int node_ = 0;
+    Kind kind_ = Kind::None;
+
+    void release() noexcept {
+        switch (kind_) {
+#ifdef USE_NUMA
+        case Kind::Libnuma: numa_free(ptr_, bytes_); break;
+#endif
+#ifdef __linux__
+        case Kind::Mmap:    munmap(ptr_, bytes_); break;
+#endif
+        case Kind::Heap:    ::operator delete(ptr_); break;
+        default: break;
+        }
+        ptr_ = nullptr;
+        kind_ = Kind::None;
+    }
+};
+
+// =============================================================
+//  NumaWeights — unpacked int4 weights (M × K, one nibble per
+//  byte) split into row slices, one per NUMA node, sized by the
+//  node's CPU count. Each slice is copied (first-touched) by a
+//  thread pinned to its node.
+// =============================================================
+class NumaWeights {
+public:
+    struct Slice {
+        size_t row_begin = 0, rows = 0;
+        size_t node_index = 0;   // index into the topology
+        int node = 0;            // kernel node id
+        NodeBuffer buf;
+        const uint8_t* data() const { return static_cast<const uint8_t*>(buf.data()); }
+    };
+
+    NumaWeights(const uint8_t* W, size_t M, size_t K,
+                const NumaTopology& topo = numa_topology())
+      : M_(M), K_(K)
+    {
+        const size_t nodes = topo.num_nodes();
+        const size_t cpus  = topo.num_cpus();
+        size_t row = 0, cpu_acc = 0;
+        for (size_t n = 0; n < nodes; ++n) {
+            cpu_acc += topo.node_cpus[n].size();
+            size_t row_end = (n + 1 == nodes) ? M : M * cpu_acc / cpus;
+            Slice s;
+            s.row_begin = row;
+            s.rows = row_end - row;
+            s.node_index = n;
+            s.node = topo.node_ids[n];
+            slices_.push_back(std::move(s));
+            row = row_end;
+        }
+
+        std::vector<std::thread> threads;
+        for (auto& s : slices_) {
+            if (s.rows == 0) continue;
+            threads.emplace_back([&, W]() {
+                pin_current_thread(topo.node_cpus[s.node_index].front());
+                s.buf = NodeBuffer(s.rows * K_, s.node);
+                std::memcpy(s.buf.data(), W + s.row_begin * K_, s.rows * K_);
+            });
+        }
+        for (auto& thr : threads) thr.join();
+    }
+
+    size_t rows() const noexcept { return M_; }
+    size_t cols() const noexcept { return K_; }
+    const std::vector<Slice>& slices() const noexcept { return slices_; }
+
+private:
+    size_t M_, K_;
+    std::vector<Slice> slices_;
+};
@@ -0,0 +1,235 @@
+#pragma once
+#include <vector>
+#include <string>
+#include <thread>
+#include <chrono>
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+
+#ifdef __linux__
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+// =============================================================
+//  Hardware performance counters and roofline model
+//  * PerfCounters wraps perf_event_open for the calling process,
+//    user space only, inherited by threads spawned while it runs
+//    (the GEMM workers). Counters the kernel or PMU refuses (VMs,
+//    containers, perf_event_paranoid > 2) are reported missing.
+//  * DRAM traffic is estimated as LLC misses × cache line size;
+//    uncore memory-controller counters are not portable enough.
+//  * measure_roofline() times an L1-resident multiply-add loop
+//    (peak Gop/s) and a streaming read (peak GB/s) on the given
+//    number of threads; classify() places a kernel run on it.
+// =============================================================
+
+enum class PerfEvent { Cycles, Instructions, L1DMisses, LLCMisses, Count };
+
+inline const char* perf_event_name(PerfEvent e) {
+    switch (e) {
+    case PerfEvent::Cycles:       return "cycles";
+    case PerfEvent::Instructions: return "instructions";
+    case PerfEvent::L1DMisses:    return "L1d-misses";
+    case PerfEvent::LLCMisses:    return "LLC-misses";
+    default:                      return "?";
+    }
+}
+
+struct PerfSample {
+    static constexpr size_t kEvents = size_t(PerfEvent::Count);
+    uint64_t value[kEvents] = {};
+    bool     valid[kEvents] = {};
+    double   seconds = 0.0;
+
+    bool has(PerfEvent e) const noexcept { return valid[size_t(e)]; }
+    uint64_t get(PerfEvent e) const noexcept { return value[size_t(e)]; }
+    double ipc() const noexcept {
+        return has(PerfEvent::Cycles) && has(PerfEvent::Instructions) && get(PerfEvent::Cycles)
+             ? double(get(PerfEvent::Instructions)) / double(get(PerfEvent::Cycles)) : 0.0;
+    }
+    // Estimated DRAM bytes (0 when LLC misses are not counted)
+    double dram_bytes(size_t line = 64) const noexcept {
+        return has(PerfEvent::LLCMisses) ? double(get(PerfEvent::LLCMisses)) * double(line) : 0.0;
+    }
+};
+
+class PerfCounters {
+public:
+    PerfCounters() {
+        for (size_t i = 0; i < PerfSample::kEvents; ++i) fd_[i] = open_event(PerfEvent(i));
+    }
+    ~PerfCounters() {
+#ifdef __linux__
+        for (int fd : fd_) if (fd >= 0) close(fd);
+#endif
+    }
+    PerfCounters(const PerfCounters&) = delete;
+    PerfCounters& operator=(const PerfCounters&) = delete;
+
+    bool available() const noexcept {
+        return std::any_of(std::begin(fd_), std::end(fd_), [](int fd) { return fd >= 0; });
+    }
+
+    void start() {
+#ifdef __linux__
+        for (int fd : fd_) if (fd >= 0) { ioctl(fd, PERF_EVENT_IOC_RESET, 0); ioctl(fd, PERF_EVENT_IOC_ENABLE, 0); }
+#endif
+        t0_ = std::chrono::steady_clock::now();
+    }
+
+    PerfSample stop() {
+        PerfSample s;
+        s.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - t0_).count();
+#ifdef __linux__
+        for (size_t i = 0; i < PerfSample::kEvents; ++i) {
+            if (fd_[i] < 0) continue;
+            ioctl(fd_[i], PERF_EVENT_IOC_DISABLE, 0);
+            uint64_t buf[3];   // value, time enabled, time running
+            if (read(fd_[i], buf, sizeof(buf)) != ssize_t(sizeof(buf))) continue;
+            // scale up when the PMU multiplexed this counter
+            s.value[i] = buf[2] ? uint64_t(double(buf[0]) * double(buf[1]) / double(buf[2])) : buf[0];
+            s.valid[i] = buf[2] != 0;
+        }
+#endif
+        return s;
+    }
+
+    // Runs fn() once under the counters
+    template<typename Fn>
+    PerfSample measure(Fn&& fn) {
+        start();
+        fn();
+        return stop();
+    }
+
+private:
+    int fd_[PerfSample::kEvents];
+    std::chrono::steady_clock::time_point t0_;
+
+    static int open_event(PerfEvent e) {
+#ifdef __linux__
+        perf_event_attr attr;
+        std::memset(&attr, 0, sizeof(attr));
+        attr.size = sizeof(attr);
+        switch (e) {
+        case PerfEvent::Cycles:
+            attr.type = PERF_TYPE_HARDWARE; attr.config = PERF_COUNT_HW_CPU_CYCLES; break;
+        case PerfEvent::Instructions:
+            attr.type = PERF_TYPE_HARDWARE; attr.config = PERF_COUNT_HW_INSTRUCTIONS; break;
+        case PerfEvent::L1DMisses:
+            attr.type = PERF_TYPE_HW_CACHE;
+            attr.config = PERF_COUNT_HW_CACHE_L1D
+                        | (PERF_COUNT_HW_CACHE_OP_READ << 8)
+                        | (PERF_COUNT_HW_CACHE_RESULT_MISS << 16);
+            break;
+        case PerfEvent::LLCMisses:
+            attr.type = PERF_TYPE_HARDWARE; attr.config = PERF_COUNT_HW_CACHE_MISSES; break;
+        default:
+            return -1;
+        }
+        attr.disabled = 1;
+        attr.inherit = 1;          // count the worker threads the kernels spawn
+        attr.exclude_kernel = 1;
+        attr.exclude_hv = 1;
+        attr.read_format = PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+        return int(syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0));
+#else
+        (void)e;
+        return -1;
+#endif
+    }
+};
+
+// -------------------------------------------------------------
+//  Roofline
+// -------------------------------------------------------------
+
+struct Roofline {
+    double peak_gops = 0.0;   // Gop/s (multiply + add = 2 ops)
+    double peak_gbps = 0.0;   // GB/s streaming read
+    // Arithmetic intensity (op/byte) where the two roofs meet
+    double ridge() const noexcept { return peak_gbps > 0 ? peak_gops / peak_gbps : 0.0; }
+    double attainable_gops(double intensity) const noexcept {
+        return std::min(peak_gops, intensity * peak_gbps);
+    }
+};
+
+struct RooflinePoint {
+    double gops = 0.0;         // achieved
+    double gbps = 0.0;         // achieved
+    double intensity = 0.0;    // op / byte
+    double attainable = 0.0;   // roof at this intensity
+    bool   memory_bound = false;
+    double efficiency() const noexcept { return attainable > 0 ? gops / attainable : 0.0; }
+};
+
+// ops and bytes of one run lasting `seconds`
+inline RooflinePoint classify(double ops, double bytes, double seconds, const Roofline& roof) {
+    RooflinePoint p;
+    if (seconds <= 0 || bytes <= 0) return p;
+    p.gops = ops / seconds * 1e-9;
+    p.gbps = bytes / seconds * 1e-9;
+    p.intensity = ops / bytes;
+    p.attainable = roof.attainable_gops(p.intensity);
+    p.memory_bound = p.intensity < roof.ridge();
+    return p;
+}
+
+namespace detail {
+
+template<typename Fn>
+double run_on_threads(size_t num_threads, Fn fn) {
+    const size_t n = std::max<size_t>(1, num_threads);
+    auto t0 = std::chrono::steady_clock::now();
+    std::vector<std::thread> threads;
+    for (size_t t = 1; t < n; ++t) threads.emplace_back(fn, t);
+    fn(size_t(0));
+    for (auto& thr : threads) thr.join();
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count();
+}
+
+} // namespace detail
+
+// Measures the machine's roofs. mem_bytes is the streamed buffer size
+// (well beyond the LLC); reps repeats the compute loop.
+inline Roofline measure_roofline(size_t num_threads = 1,
+                                 size_t mem_bytes = size_t(256) << 20,
+                                 size_t reps = 20000)
+{
+    const size_t n = std::max<size_t>(1, num_threads);
+    Roofline r;
+
+    // compute roof: independent multiply-add chains over an L1-resident block
+    constexpr size_t kLanes = 64;
+    std::vector<float> sink(n);
+    double secs = detail::run_on_threads(n, [&](size_t t) {
+        alignas(64) float acc[kLanes], x[kLanes];
+        for (size_t i = 0; i < kLanes; ++i) { acc[i] = float(i); x[i] = 1.0f + 1e-7f * float(i); }
+        for (size_t rep = 0; rep < reps; ++rep)
+            for (size_t i = 0; i < kLanes; ++i) acc[i] = acc[i] * x[i] + 1e-7f;
+        float s = 0;
+        for (float a : acc) s += a;
+        sink[t] = s;   // keeps the loop alive
+    });
+    r.peak_gops = 2.0 * double(kLanes) * double(reps) * double(n) / secs * 1e-9;
+
+    // bandwidth roof: each thread sums its slice of a large buffer
+    const size_t words = mem_bytes / sizeof(uint64_t);
+    std::vector<uint64_t> buf(words, 1);
+    std::vector<uint64_t> sums(n);
+    secs = detail::run_on_threads(n, [&](size_t t) {
+        size_t b = words * t / n, e = words * (t + 1) / n;
+        uint64_t s0 = 0, s1 = 0, s2 = 0, s3 = 0;
+        size_t i = b;
+        for (; i + 4 <= e; i += 4) { s0 += buf[i]; s1 += buf[i + 1]; s2 += buf[i + 2]; s3 += buf[i + 3]; }
+        for (; i < e; ++i) s0 += buf[i];
+        sums[t] = s0 + s1 + s2 + s3;
+    });
+    r.peak_gbps = double(words * sizeof(uint64_t)) / secs * 1e-9;
+    return r;
+}
@@ -1,6 +1,9 @@
 #pragma once
 #include <vector>
 #include <cmath>
+#include <cstddef>
+#include <type_traits>
+#include <stdexcept>
 #include "matrix.hpp"
 
 
@@ -11,40 +14,302 @@ enum class Activation {
     Tanh
 };
 
+template<typename T>
+inline T activate(T v, Activation act)
+{
+    switch(act) {
+      case Activation::ReLU:    return v>static_cast<T>(0)?v:static_cast<T>(0);
+      case Activation::Sigmoid: return static_cast<T>(1) / (static_cast<T>(1)+std::exp(-v));
+      case Activation::Tanh:    return std::tanh(v);
+      case Activation::Linear:  break;
+    }
+    return v;
+}
+
+// =============================================================
+//  Lazy element-wise expressions
+//  add_bias / add_row_bias / apply_activation / scale / cast and
+//  `a + b` (residual add) on a Matrix, a raw buffer view or
+//  another expression return small expression objects instead of
+//  a new Matrix. Nothing is computed until the expression is
+//  assigned to a Matrix (constructor or operator=) or written to
+//  a buffer with assign_to(); either runs one fused pass over the
+//  output, contiguous rows first so simple chains vectorize.
+//  A runtime activation at the root is dispatched once per
+//  evaluation, not per element.
+//  Expression nodes copy their sub-expressions but reference the
+//  matrices, views and bias vectors they read: evaluate before
+//  those go out of scope. Temporary matrices and bias vectors
+//  would dangle at once, so the builders reject them (deleted
+//  rvalue overloads); name them first.
+// =============================================================
+
+template<typename E>
+struct MatExpr {
+    const E& self() const { return static_cast<const E&>(*this); }
+};
+
+template<typename X>
+inline constexpr bool is_mat_expr_v = std::is_base_of_v<MatExpr<X>, X>;
+
+namespace detail {
+
+template<typename X> struct is_matrix : std::false_type {};
+template<typename T, typename L, typename S>
+struct is_matrix<Matrix<T,L,S>> : std::true_type {};
+
+} // namespace detail
+
+// Leaf: reads a Matrix (plain row-major storage through its pointer)
 template<typename T, typename Layout, typename Storage>
-Matrix<T,Layout,Storage> add_bias(
-    const Matrix<T,Layout,Storage>& M,
-    const std::vector<T>& bias)
-{
-    size_t R = M.rows(), C = M.cols();
-    Matrix<T,Layout,Storage> Rmat(R, C);
-    for(size_t i = 0; i < R; ++i) {
-        for(size_t j = 0; j < C; ++j) {
-            Rmat.set(i, j, M.at(i,j) + bias[j]);
+struct MatrixRef : MatExpr<MatrixRef<T,Layout,Storage>> {
+    using value_type = T;
+    const Matrix<T,Layout,Storage>& m;
+
+    explicit MatrixRef(const Matrix<T,Layout,Storage>& mat) : m(mat) {}
+    size_t rows() const { return m.rows(); }
+    size_t cols() const { return m.cols(); }
+    T at(size_t i, size_t j) const {
+        if constexpr (std::is_same_v<Layout, RowMajor> && std::is_same_v<Storage, PlainStorage<T>>)
+            return m.data()[i * m.cols() + j];
+        else
+            return m.at(i, j);
+    }
+};
+
+// Leaf: rows × cols row-major buffer with leading dimension ld,
+// e.g. a kernel's output tile for an in-place epilogue
+template<typename T>
+struct MatView : MatExpr<MatView<T>> {
+    using value_type = T;
+    const T* data;
+    size_t rows_, cols_, ld;
+
+    MatView(const T* p, size_t rows, size_t cols, size_t ld_ = 0)
+      : data(p), rows_(rows), cols_(cols), ld(ld_ ? ld_ : cols) {}
+    size_t rows() const { return rows_; }
+    size_t cols() const { return cols_; }
+    T at(size_t i, size_t j) const { return data[i * ld + j]; }
+};
+
+namespace detail {
+
+// Matrix → MatrixRef leaf, expression → copy of itself
+template<typename X>
+auto as_expr(const X& x) {
+    if constexpr (is_matrix<X>::value) return MatrixRef(x);
+    else return x;
+}
+
+template<typename X>
+using expr_t = decltype(as_expr(std::declval<const X&>()));
+
+template<typename X>
+using expr_value_t = typename expr_t<X>::value_type;
+
+template<typename X>
+inline constexpr bool matrix_like_v = is_matrix<X>::value || is_mat_expr_v<X>;
+
+} // namespace detail
+
+// f(v) element-wise: scale, cast, compile-time activations
+template<typename E, typename F>
+struct MapExpr : MatExpr<MapExpr<E,F>> {
+    using value_type = std::decay_t<decltype(std::declval<F>()(std::declval<typename E::value_type>()))>;
+    E e;
+    F f;
+
+    MapExpr(E e_, F f_) : e(std::move(e_)), f(std::move(f_)) {}
+    size_t rows() const { return e.rows(); }
+    size_t cols() const { return e.cols(); }
+    value_type at(size_t i, size_t j) const { return f(e.at(i, j)); }
+};
+
+// v + bias[j] (per column, kPerRow = false) or v + bias[i] (per row)
+template<typename E, bool kPerRow>
+struct BiasExpr : MatExpr<BiasExpr<E,kPerRow>> {
+    using value_type = typename E::value_type;
+    E e;
+    const value_type* bias;
+
+    BiasExpr(E e_, const value_type* b) : e(std::move(e_)), bias(b) {}
+    size_t rows() const { return e.rows(); }
+    size_t cols() const { return e.cols(); }
+    value_type at(size_t i, size_t j) const { return e.at(i, j) + bias[kPerRow ? i : j]; }
+};
+
+template<Activation A>
+struct ActivationFn {
+    template<typename T>
+    T operator()(T v) const { return activate(v, A); }   // constant-folded switch
+};
+
+// Activation chosen at run time
+template<typename E>
+struct ActivationExpr : MatExpr<ActivationExpr<E>> {
+    using value_type = typename E::value_type;
+    E e;
+    Activation act;
+
+    ActivationExpr(E e_, Activation a) : e(std::move(e_)), act(a) {}
+    size_t rows() const { return e.rows(); }
+    size_t cols() const { return e.cols(); }
+    value_type at(size_t i, size_t j) const { return activate(e.at(i, j), act); }
+
+    // Same expression with the activation as a template argument
+    template<typename Fn>
+    void with_static(Fn&& fn) const {
+        switch(act) {
+          case Activation::ReLU:    fn(MapExpr(e, ActivationFn<Activation::ReLU>{}));    break;
+          case Activation::Sigmoid: fn(MapExpr(e, ActivationFn<Activation::Sigmoid>{})); break;
+          case Activation::Tanh:    fn(MapExpr(e, ActivationFn<Activation::Tanh>{}));    break;
+          case Activation::Linear:  fn(e);                                                break;
         }
     }
-    return Rmat;
+};
+
+// a + b, same shape (residual connections)
+template<typename E1, typename E2>
+struct SumExpr : MatExpr<SumExpr<E1,E2>> {
+    using value_type = std::common_type_t<typename E1::value_type, typename E2::value_type>;
+    E1 a;
+    E2 b;
+
+    SumExpr(E1 a_, E2 b_) : a(std::move(a_)), b(std::move(b_)) {
+        if (a.rows() != b.rows() || a.cols() != b.cols())
+            throw std::invalid_argument("element-wise add: shape mismatch");
+    }
+    size_t rows() const { return a.rows(); }
+    size_t cols() const { return a.cols(); }
+    value_type at(size_t i, size_t j) const { return value_type(a.at(i, j)) + value_type(b.at(i, j)); }
+};
+
+// -------------------------------------------------------------
+//  Evaluation
+// -------------------------------------------------------------
+
+namespace detail {
+
+template<typename E, typename T>
+void eval_rows(const E& e, T* out, size_t ld) {
+    const size_t R = e.rows(), C = e.cols();
+    for (size_t i = 0; i < R; ++i) {
+        T* row = out + i * ld;
+        for (size_t j = 0; j < C; ++j) row[j] = static_cast<T>(e.at(i, j));
+    }
+}
+
+template<typename X> struct is_activation_expr : std::false_type {};
+template<typename E> struct is_activation_expr<ActivationExpr<E>> : std::true_type {};
+
+template<typename E, typename T>
+void eval_dispatch(const E& e, T* out, size_t ld) {
+    if constexpr (is_activation_expr<E>::value)
+        e.with_static([&](const auto& s) { eval_rows(s, out, ld); });
+    else
+        eval_rows(e, out, ld);
+}
+
+} // namespace detail
+
+// Writes the expression into a rows × cols row-major buffer (ld ≥ cols).
+// `out` may be the buffer a MatView leaf reads: each element only
+// reads its own position.
+template<typename E, typename T>
+void assign_to(const MatExpr<E>& expr, T* out, size_t ld = 0) {
+    const E& e = expr.self();
+    detail::eval_dispatch(e, out, ld ? ld : e.cols());
 }
 
-/// 2) element-wise activation
 template<typename T, typename Layout, typename Storage>
-Matrix<T,Layout,Storage> apply_activation(
-    const Matrix<T,Layout,Storage>& M,
-    Activation act)
-{
-    size_t R = M.rows(), C = M.cols();
-    Matrix<T,Layout,Storage> Rmat(R, C);
-    for(size_t i = 0; i < R; ++i) {
-        for(size_t j = 0; j < C; ++j) {
-            T v = M.at(i,j);
-            switch(act) {
-              case Activation::ReLU:    v = v>static_cast<T>(0)?v:static_cast<T>(0); break;
-              case Activation::Sigmoid: v = static_cast<T>(1) / (static_cast<T>(1)+std::exp(-v)); break;
-              case Activation::Tanh:    v = std::tanh(v); break;
-              case Activation::Linear:  /* no-op */       break;
-            }
-            Rmat.set(i, j, v);
-        }
+template<typename E>
+void Matrix<T,Layout,Storage>::assign_expr(const E& e) {
+    if constexpr (std::is_same_v<Layout, RowMajor> && std::is_same_v<Storage, PlainStorage<T>>) {
+        detail::eval_dispatch(e, data(), cols_);
+    } else {
+        for (size_t i = 0; i < rows_; ++i)
+            for (size_t j = 0; j < cols_; ++j)
+                set(i, j, static_cast<T>(e.at(i, j)));
     }
-    return Rmat;
+}
+
+// -------------------------------------------------------------
+//  Builders (Matrix, MatView or expression operands)
+// -------------------------------------------------------------
+
+/// 1) bias per column: R(i, j) = M(i, j) + bias[j]
+template<typename X, std::enable_if_t<detail::matrix_like_v<X>, int> = 0>
+auto add_bias(const X& M, const std::vector<detail::expr_value_t<X>>& bias)
+{
+    auto e = detail::as_expr(M);
+    if (bias.size() < e.cols()) throw std::invalid_argument("add_bias: one bias per column");
+    return BiasExpr<decltype(e), false>(e, bias.data());
+}
+
+/// bias per row (output feature), as in layer epilogues
+template<typename X, std::enable_if_t<detail::matrix_like_v<X>, int> = 0>
+auto add_row_bias(const X& M, const detail::expr_value_t<X>* bias)
+{
+    auto e = detail::as_expr(M);
+    return BiasExpr<decltype(e), true>(e, bias);
+}
+
+/// 2) element-wise activation
+template<typename X, std::enable_if_t<detail::matrix_like_v<X>, int> = 0>
+auto apply_activation(const X& M, Activation act)
+{
+    return ActivationExpr(detail::as_expr(M), act);
+}
+
+template<typename X, std::enable_if_t<detail::matrix_like_v<X>, int> = 0>
+auto scale(const X& M, detail::expr_value_t<X> s)
+{
+    return MapExpr(detail::as_expr(M), [s](auto v) { return v * s; });
+}
+
+template<typename U, typename X, std::enable_if_t<detail::matrix_like_v<X>, int> = 0>
+auto cast(const X& M)
+{
+    return MapExpr(detail::as_expr(M), [](auto v) { return static_cast<U>(v); });
+}
+
+/// residual add: R = a + b
+template<typename X, typename Y,
+         std::enable_if_t<detail::matrix_like_v<X> && detail::matrix_like_v<Y>, int> = 0>
+auto operator+(const X& a, const Y& b)
+{
+    return SumExpr(detail::as_expr(a), detail::as_expr(b));
+}
+
+
+// Temporaries: the expression would outlive them (see above)
+template<typename T, typename L, typename S, typename... Args>
+void add_bias(Matrix<T,L,S>&&, Args&&...) = delete;
+template<typename X, std::enable_if_t<detail::matrix_like_v<X>, int> = 0>
+void add_bias(const X&, std::vector<detail::expr_value_t<X>>&&) = delete;
+template<typename T, typename L, typename S, typename... Args>
+void add_row_bias(Matrix<T,L,S>&&, Args&&...) = delete;
+template<typename T, typename L, typename S, typename... Args>
+void apply_activation(Matrix<T,L,S>&&, Args&&...) = delete;
+template<typename T, typename L, typename S, typename... Args>
+void scale(Matrix<T,L,S>&&, Args&&...) = delete;
+template<typename U, typename T, typename L, typename S>
+void cast(Matrix<T,L,S>&&) = delete;
+template<typename T, typename L, typename S, typename Y,
+         std::enable_if_t<detail::matrix_like_v<Y>, int> = 0>
+void operator+(Matrix<T,L,S>&&, const Y&) = delete;
+template<typename X, typename T, typename L, typename S,
+         std::enable_if_t<detail::matrix_like_v<X>, int> = 0>
+void operator+(const X&, Matrix<T,L,S>&&) = delete;
+
+
+/// 3) fused in-place bias + activation over a rows × cols row-major buffer,
+///    bias indexed per row (output feature); used by layer epilogues
+template<typename T>
+void bias_activation_rows_inplace(T* data, size_t rows, size_t cols,
+                                  const T* row_bias, Activation act)
+{
+    const MatView<T> C(data, rows, cols);
+    if (row_bias) assign_to(apply_activation(add_row_bias(C, row_bias), act), data);
+    else          assign_to(apply_activation(C, act), data);
 }
@@ -2,6 +2,12 @@
 #include <algorithm>
 #include <cmath>
 #include <cstdint>
+#include <type_traits>
+#include <cstddef>
+#include <stdexcept>
+#include <vector>
+
+#include "storage_policies.hpp"
 
 inline uint8_t quantize_int4(float fp16_val, float scale, int zero_point = 8) {
 
@@ -24,3 +30,138 @@ inline float dequantize_int4(uint8_t q, float scale, int zero_point = 8) {
     int qi = static_cast<int>(q) - zero_point;
     return static_cast<float>(qi) * scale;
 }
+
+
+// Symmetric int8 quantization: q = clamp(round(v / scale), -127, 127)
+inline int8_t quantize_int8(float val, float inv_scale) {
+    int q = static_cast<int>(std::lround(val * inv_scale));
+    q = std::clamp(q, -127, 127);
+    return static_cast<int8_t>(q);
+}
+
+// Dynamic per-token scales for a K × N row-major activation matrix, where
+// every column is one token: scale[j] = max_k |A[k][j]| / 127.
+// An all-zero token gets scale 1 so that its quantized values stay zero.
+// A may be float or fp16_t (half rows are widened one at a time).
+// token_major: A is stored N × K, one contiguous row per token.
+template<typename AT>
+inline void compute_token_scales_int8(const AT* A, size_t K, size_t N,
+                                      float* scales, bool token_major = false) {
+    std::fill(scales, scales + N, 0.0f);
+    if (token_major) {
+        std::vector<float> scratch(std::is_same_v<AT, float> ? 0 : K);
+        for (size_t j = 0; j < N; ++j) {
+            const float* tok = detail::row_as_float(A + j * K, K, scratch.data());
+            float m = 0.0f;
+            for (size_t k = 0; k < K; ++k) m = std::max(m, std::fabs(tok[k]));
+            scales[j] = m > 0.0f ? m / 127.0f : 1.0f;
+        }
+        return;
+    }
+    std::vector<float> scratch(std::is_same_v<AT, float> ? 0 : N);
+    for (size_t k = 0; k < K; ++k) {
+        const float* row = detail::row_as_float(A + k * N, N, scratch.data());
+        for (size_t j = 0; j < N; ++j)
+            scales[j] = std::max(scales[j], std::fabs(row[j]));
+    }
+    for (size_t j = 0; j < N; ++j)
+        scales[j] = scales[j] > 0.0f ? scales[j] / 127.0f : 1.0f;
+}
+
+// =============================================================
+//  Codebook (non-uniform 4-bit) quantization
+//  Every group of `group_rows` weight rows carries 16 float values;
+//  a weight is stored as the 4-bit index of its nearest value.
+//  Codebooks start from NF4 (normal-float quantiles, QLoRA) scaled
+//  by the group's absmax and are refined by 1-D k-means.
+// =============================================================
+
+constexpr float kNF4Codebook[16] = {
+    -1.0f, -0.6961928f, -0.5250731f, -0.3949175f,
+    -0.2844414f, -0.1847734f, -0.0910500f, 0.0f,
+     0.0795803f, 0.1609302f, 0.2461123f, 0.3379152f,
+     0.4407098f, 0.5626170f, 0.7229568f, 1.0f };
+
+// Index of the codebook entry closest to v
+inline uint8_t nearest_code(float v, const float* codebook) {
+    uint8_t best = 0;
+    float best_d = std::fabs(v - codebook[0]);
+    for (uint8_t c = 1; c < 16; ++c) {
+        float d = std::fabs(v - codebook[c]);
+        if (d < best_d) { best_d = d; best = c; }
+    }
+    return best;
+}
+
+// Fits 16 values to x[0 … n): NF4 · absmax, then `iters` Lloyd steps.
+// iters = 0 yields plain NF4. Returns the mean squared error.
+inline double fit_codebook(const float* x, size_t n, float* codebook, int iters = 10) {
+    float absmax = 0.0f;
+    for (size_t i = 0; i < n; ++i) absmax = std::max(absmax, std::fabs(x[i]));
+    if (absmax == 0.0f) absmax = 1.0f;
+    for (size_t c = 0; c < 16; ++c) codebook[c] = kNF4Codebook[c] * absmax;
+
+    double sum[16], err = 0.0;
+    size_t cnt[16];
+    for (int it = 0; it <= iters; ++it) {
+        std::fill(sum, sum + 16, 0.0);
+        std::fill(cnt, cnt + 16, size_t(0));
+        err = 0.0;
+        for (size_t i = 0; i < n; ++i) {
+            uint8_t c = nearest_code(x[i], codebook);
+            double d = double(x[i]) - codebook[c];
+            err += d * d;
+            sum[c] += x[i];
+            ++cnt[c];
+        }
+        if (it == iters) break;
+        // empty clusters keep their value
+        for (size_t c = 0; c < 16; ++c)
+            if (cnt[c]) codebook[c] = float(sum[c] / double(cnt[c]));
+    }
+    return n ? err / double(n) : 0.0;
+}
+
+// Rows per codebook by default: matmul_lut_codebook builds one
+// 16-entry table per row group and k, so groups much smaller than
+// the 16 entries spend more time building tables than reading them
+constexpr size_t kCodebookGroupRows = 64;
+
+struct CodebookWeights {
+    size_t rows = 0, cols = 0, group_rows = kCodebookGroupRows;
+    std::vector<uint8_t> codes;       // rows × cols, one index (0‥15) per byte
+    std::vector<float>   codebooks;   // num_groups() × 16
+
+    size_t num_groups() const noexcept { return (rows + group_rows - 1) / group_rows; }
+    const float* codebook_of_row(size_t r) const noexcept {
+        return &codebooks[(r / group_rows) * 16];
+    }
+};
+
+// Quantizes a row-major M × K float matrix with one codebook per
+// `group_rows` rows
+inline CodebookWeights quantize_codebook(const float* W, size_t M, size_t K,
+                                         size_t group_rows = kCodebookGroupRows,
+                                         int iters = 10) {
+    if (group_rows == 0) throw std::invalid_argument("group_rows must be positive");
+    CodebookWeights q;
+    q.rows = M; q.cols = K; q.group_rows = group_rows;
+    q.codes.resize(M * K);
+    q.codebooks.resize(q.num_groups() * 16);
+    for (size_t g = 0; g < q.num_groups(); ++g) {
+        size_t r0 = g * group_rows, r1 = std::min(M, r0 + group_rows);
+        float* cb = &q.codebooks[g * 16];
+        fit_codebook(W + r0 * K, (r1 - r0) * K, cb, iters);
+        for (size_t i = r0 * K; i < r1 * K; ++i) q.codes[i] = nearest_code(W[i], cb);
+    }
+    return q;
+}
+
+inline std::vector<float> dequantize_codebook(const CodebookWeights& q) {
+    std::vector<float> W(q.rows * q.cols);
+    for (size_t r = 0; r < q.rows; ++r) {
+        const float* cb = q.codebook_of_row(r);
+        for (size_t k = 0; k < q.cols; ++k) W[r * q.cols + k] = cb[q.codes[r * q.cols + k]];
+    }
+    return W;
+}
@@ -0,0 +1,334 @@
+#pragma once
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <exception>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+#include <new>
+
+#ifdef __linux__
+#include <cerrno>
+#include <fcntl.h>
+#include <signal.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#include "gemm_engine.hpp"
+
+// =============================================================
+//  Multi-process tensor-parallel GEMM over POSIX shared memory
+//  `world` local processes each hold one shard of an M × K int4
+//  weight matrix — a block of output rows, or a block of K — and
+//  attach to the same named segment:
+//
+//    control block | activations (K × max_n floats) | outputs
+//
+//  Rank 0 is the caller: matmul() writes the activations, bumps
+//  the call generation (the start barrier) and computes its own
+//  shard while the other ranks, parked in serve(), compute
+//  theirs; each rank then counts itself into `done` (the end
+//  barrier), even when its shard failed. `done` and `failed`
+//  carry the generation they belong to, so a rank that reports
+//  after rank 0 gave up on a call cannot leak into the next one.
+//  Ranks > 0 only attach to a segment whose creator is still
+//  alive, never to one left behind by a crashed run.
+//  Row shards write disjoint rows of one M × N output; K shards
+//  write per-rank M × N partials that rank 0 sums in rank order,
+//  so results are deterministic.
+//  Every rank runs the shard through its own Engine (any backend;
+//  "lut" is exact for both modes — with "w4a8", K shards quantize
+//  their activation slice with per-slice token scales).
+//  Waits spin briefly, then sleep; a peer that stops responding
+//  surfaces as std::runtime_error after `timeout_ms`.
+// =============================================================
+
+enum class ShardMode : uint32_t { Rows = 0, K = 1 };
+
+class ShmTensorParallel {
+public:
+    // [begin, end) of `extent` (M or K) owned by `rank`
+    static std::pair<size_t, size_t> shard_range(size_t extent, int world, int rank) {
+        return {extent * size_t(rank) / size_t(world), extent * size_t(rank + 1) / size_t(world)};
+    }
+
+    // W_shard: this rank's unpacked nibbles — rows [r0, r1) × K in Rows
+    // mode, M × [k0, k1) in K mode (see shard_range). M and K are the
+    // full dimensions; max_n bounds the activation columns per call.
+    ShmTensorParallel(const std::string& name, int world, int rank,
+                      std::vector<uint8_t> W_shard, int M, int K,
+                      ShardMode mode = ShardMode::Rows,
+                      const std::string& backend = "lut",
+                      int max_n = 256, int timeout_ms = 30000)
+      : name_(name[0] == '/' ? name : "/" + name), world_(world), rank_(rank),
+        M_(M), K_(K), max_n_(max_n), mode_(mode), timeout_ms_(timeout_ms),
+        engine_(backend)
+    {
+        if (world < 1 || rank < 0 || rank >= world)
+            throw std::invalid_argument("ShmTensorParallel: rank must be in [0, world)");
+        if (M < 1 || K < 1 || max_n < 1)
+            throw std::invalid_argument("ShmTensorParallel: M, K and max_n must be positive");
+        auto [b, e] = shard_range(mode == ShardMode::Rows ? M : K, world, rank);
+        shard_begin_ = b; shard_end_ = e;
+        const size_t expect = mode == ShardMode::Rows ? (e - b) * size_t(K) : size_t(M) * (e - b);
+        if (W_shard.size() != expect)
+            throw std::invalid_argument("ShmTensorParallel: weight shard size does not match its range");
+        if (backend == "lut") engine_.generate_lut(4);
+        if (e > b)   // packed once; every call reuses the handle
+            W_ = mode == ShardMode::Rows ? engine_.register_weights(W_shard, int(e - b), K)
+                                         : engine_.register_weights(W_shard, M, int(e - b));
+        attach();
+    }
+
+    ~ShmTensorParallel() {
+#ifdef __linux__
+        if (ctrl_) {
+            if (rank_ == 0) {
+                ctrl_->shutdown.store(1, std::memory_order_release);
+                ctrl_->generation.fetch_add(1, std::memory_order_acq_rel);
+            }
+            ctrl_->attached.fetch_sub(1, std::memory_order_acq_rel);
+            munmap(static_cast<void*>(ctrl_), bytes_);
+        }
+        if (rank_ == 0) shm_unlink(name_.c_str());
+#endif
+    }
+    ShmTensorParallel(const ShmTensorParallel&) = delete;
+    ShmTensorParallel& operator=(const ShmTensorParallel&) = delete;
+
+    int world() const noexcept { return world_; }
+    int rank() const noexcept { return rank_; }
+
+    // Rank 0: C = W · A for A (K × N, row-major), N ≤ max_n
+    std::vector<float> matmul(const std::vector<float>& A, int N) {
+        if (rank_ != 0) throw std::runtime_error("matmul is called on rank 0; other ranks serve()");
+        if (N < 1 || N > max_n_) throw std::invalid_argument("N must be in [1, max_n]");
+        if (A.size() != size_t(K_) * N)
+            throw std::invalid_argument("activations size does not match K × N");
+        std::memcpy(activations(), A.data(), A.size() * sizeof(float));
+        const uint64_t gen = ctrl_->generation.load(std::memory_order_relaxed) + 1;
+        ctrl_->n.store(uint32_t(N), std::memory_order_relaxed);
+        ctrl_->done.store(done_word(gen, 0), std::memory_order_relaxed);
+        ctrl_->generation.store(gen, std::memory_order_release);   // start barrier
+
+        // always pass the end barrier, so the next call starts with every rank idle
+        std::exception_ptr err;
+        try { compute_shard(N); } catch (...) { err = std::current_exception(); }
+        count_done(gen);
+        wait_until([&] { return ctrl_->done.load(std::memory_order_acquire)
+                                == done_word(gen, uint32_t(world_)); },
+                   "waiting for ranks to finish");
+        if (err) std::rethrow_exception(err);
+        if (ctrl_->failed.load(std::memory_order_acquire) == gen)
+            throw std::runtime_error("a tensor-parallel rank failed to compute its shard");
+
+        const size_t MN = size_t(M_) * N;
+        std::vector<float> C(MN, 0.0f);
+        if (mode_ == ShardMode::Rows) {
+            std::memcpy(C.data(), outputs(0), MN * sizeof(float));
+        } else {
+            for (int r = 0; r < world_; ++r) {
+                const float* part = outputs(r);
+                for (size_t i = 0; i < MN; ++i) C[i] += part[i];
+            }
+        }
+        return C;
+    }
+
+    // Ranks > 0: computes shards for rank 0's calls until it shuts down;
+    // throws std::runtime_error once rank 0's process is gone (checked
+    // every timeout_ms while idle)
+    void serve() {
+        if (rank_ == 0) throw std::runtime_error("rank 0 drives calls with matmul()");
+        uint64_t seen = seen_generation_;
+        for (;;) {
+            auto check_at = std::chrono::steady_clock::now() + std::chrono::milliseconds(timeout_ms_);
+            wait_until([&] {
+                if (ctrl_->generation.load(std::memory_order_acquire) != seen) return true;
+                if (std::chrono::steady_clock::now() < check_at) return false;
+                if (!creator_alive(ctrl_->creator))
+                    throw std::runtime_error("ShmTensorParallel: rank 0 exited without shutting down");
+                check_at += std::chrono::milliseconds(timeout_ms_);
+                return false;
+            }, nullptr);
+            seen = ctrl_->generation.load(std::memory_order_acquire);
+            if (ctrl_->shutdown.load(std::memory_order_acquire)) return;
+            try {
+                compute_shard(int(ctrl_->n.load(std::memory_order_relaxed)));
+            } catch (...) {
+                ctrl_->failed.store(seen, std::memory_order_release);
+            }
+            count_done(seen);
+        }
+    }
+
+private:
+    struct Control {
+        std::atomic<uint64_t> magic{0};
+        uint32_t world = 0, m = 0, k = 0, max_n = 0, mode = 0;
+        int32_t creator = 0;                 // rank 0's pid
+        std::atomic<uint32_t> attached{0};
+        std::atomic<uint32_t> n{0};
+        std::atomic<uint32_t> shutdown{0};
+        std::atomic<uint64_t> done{0};       // done_word(generation, ranks finished)
+        std::atomic<uint64_t> failed{0};     // generation of the last failed call
+        std::atomic<uint64_t> generation{0};
+    };
+    static_assert(sizeof(Control) <= 256, "control block must fit its slot");
+    static_assert(std::atomic<uint64_t>::is_always_lock_free,
+                  "cross-process atomics must be lock-free");
+    static constexpr uint64_t kMagic = 0x4d5047454d4d5450ull;   // "MPGEMMTP"
+    static constexpr size_t kControlBytes = 256;
+
+    std::string name_;
+    int world_, rank_, M_, K_, max_n_;
+    ShardMode mode_;
+    int timeout_ms_;
+    Engine engine_;
+    WeightHandle W_;
+    size_t shard_begin_ = 0, shard_end_ = 0;
+    Control* ctrl_ = nullptr;
+    size_t bytes_ = 0;
+    uint64_t seen_generation_ = 0;
+
+    float* activations() const {
+        return reinterpret_cast<float*>(reinterpret_cast<char*>(ctrl_) + kControlBytes);
+    }
+    // Output region of rank r (all ranks share region 0 in Rows mode)
+    float* outputs(int r) const {
+        const size_t slot = mode_ == ShardMode::Rows ? 0 : size_t(r);
+        return activations() + size_t(K_) * max_n_ + slot * size_t(M_) * max_n_;
+    }
+
+    static uint64_t done_word(uint64_t gen, uint32_t count) {
+        return (gen << 32) | count;
+    }
+
+    // Counts this rank into call `gen`'s end barrier; a no-op once
+    // rank 0 has moved on to a later call
+    void count_done(uint64_t gen) {
+        uint64_t d = ctrl_->done.load(std::memory_order_acquire);
+        while ((d >> 32) == (gen & 0xFFFFFFFFu)
+               && !ctrl_->done.compare_exchange_weak(d, d + 1, std::memory_order_acq_rel)) {}
+    }
+
+    void compute_shard(int N) {
+        const float* A = activations();
+        const size_t len = shard_end_ - shard_begin_;
+        if (len == 0) return;
+        if (mode_ == ShardMode::Rows) {
+            std::vector<float> Af(A, A + size_t(K_) * N);
+            auto C = engine_.matmul(W_, Af, N);
+            std::memcpy(outputs(rank_) + shard_begin_ * N, C.data(), C.size() * sizeof(float));
+        } else {
+            std::vector<float> Af(A + shard_begin_ * N, A + shard_end_ * N);   // K-slice rows
+            auto C = engine_.matmul(W_, Af, N);
+            std::memcpy(outputs(rank_), C.data(), C.size() * sizeof(float));
+        }
+    }
+
+    // Spins briefly, then sleeps; what == nullptr waits without a deadline
+    template<typename Pred>
+    void wait_until(Pred ready, const char* what) const {
+        const auto deadline = std::chrono::steady_clock::now()
+                            + std::chrono::milliseconds(timeout_ms_);
+        for (unsigned spin = 0; !ready(); ++spin) {
+            if (spin < 2048) { std::this_thread::yield(); continue; }
+            std::this_thread::sleep_for(std::chrono::microseconds(50));
+            if (what && std::chrono::steady_clock::now() > deadline)
+                throw std::runtime_error(std::string("ShmTensorParallel: timed out ") + what);
+        }
+    }
+
+    static bool creator_alive(int32_t pid) {
+#ifdef __linux__
+        return pid > 0 && (kill(pid_t(pid), 0) == 0 || errno == EPERM);
+#else
+        return pid > 0;
+#endif
+    }
+
+    void attach() {
+#ifdef __linux__
+        const size_t out_slots = mode_ == ShardMode::Rows ? 1 : size_t(world_);
+        bytes_ = kControlBytes
+               + (size_t(K_) + out_slots * size_t(M_)) * size_t(max_n_) * sizeof(float);
+        if (rank_ == 0) {
+            shm_unlink(name_.c_str());   // stale segment of a crashed run
+            int fd = shm_open(name_.c_str(), O_CREAT | O_EXCL | O_RDWR, 0600);
+            if (fd < 0 || ftruncate(fd, off_t(bytes_)) != 0) {
+                if (fd >= 0) { ::close(fd); shm_unlink(name_.c_str()); }
+                throw std::runtime_error("cannot create shared memory segment " + name_);
+            }
+            void* p = mmap(nullptr, bytes_, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+            ::close(fd);
+            if (p == MAP_FAILED) {
+                shm_unlink(name_.c_str());
+                throw std::runtime_error("cannot map shared memory segment " + name_);
+            }
+            ctrl_ = new (p) Control{};
+            ctrl_->world = uint32_t(world_); ctrl_->m = uint32_t(M_); ctrl_->k = uint32_t(K_);
+            ctrl_->max_n = uint32_t(max_n_); ctrl_->mode = uint32_t(mode_);
+            ctrl_->creator = int32_t(getpid());
+            ctrl_->magic.store(kMagic, std::memory_order_release);   // header complete
+        } else {
+            // retry until rank 0 has published a live segment (a finished
+            // run's segment, still linked, carries the shutdown flag; a
+            // crashed run's has a creator that no longer exists)
+            wait_until([&] {
+                int fd = shm_open(name_.c_str(), O_RDWR, 0600);
+                if (fd < 0) return false;
+                struct stat st;
+                void* p = MAP_FAILED;
+                if (fstat(fd, &st) == 0 && size_t(st.st_size) >= bytes_)
+                    p = mmap(nullptr, bytes_, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+                ::close(fd);
+                if (p == MAP_FAILED) return false;
+                auto* c = static_cast<Control*>(p);
+                if (c->magic.load(std::memory_order_acquire) == kMagic
+                    && !c->shutdown.load(std::memory_order_acquire)
+                    && creator_alive(c->creator)) {
+                    ctrl_ = c;
+                    return true;
+                }
+                munmap(p, bytes_);
+                return false;
+            }, "waiting for rank 0 to create the segment");
+        }
+        // the destructor does not run if the constructor throws: until
+        // attach() completes, a failure unmaps the segment, and rank 0
+        // also tells ranks that attached to exit and unlinks the name
+        struct Undo {
+            ShmTensorParallel& tp;
+            bool armed = true;
+            ~Undo() {
+                if (!armed) return;
+                if (tp.rank_ == 0) {
+                    tp.ctrl_->shutdown.store(1, std::memory_order_release);
+                    tp.ctrl_->generation.fetch_add(1, std::memory_order_acq_rel);
+                    shm_unlink(tp.name_.c_str());
+                }
+                munmap(static_cast<void*>(tp.ctrl_), tp.bytes_);
+                tp.ctrl_ = nullptr;
+            }
+        } undo{*this};
+        if (ctrl_->world != uint32_t(world_) || ctrl_->m != uint32_t(M_) || ctrl_->k != uint32_t(K_)
+            || ctrl_->max_n != uint32_t(max_n_) || ctrl_->mode != uint32_t(mode_))
+            throw std::invalid_argument("ShmTensorParallel: ranks disagree on the layer shape");
+        seen_generation_ = ctrl_->generation.load(std::memory_order_acquire);
+        ctrl_->attached.fetch_add(1, std::memory_order_acq_rel);
+        if (rank_ == 0)
+            wait_until([&] { return ctrl_->attached.load(std::memory_order_acquire) == uint32_t(world_); },
+                       "waiting for all ranks to attach");
+        undo.armed = false;
+#else
+        throw std::runtime_error("ShmTensorParallel requires POSIX shared memory");
+#endif
+    }
+};
@@ -0,0 +1,255 @@
+#pragma once
+#include <vector>
+#include <cstddef>
+#include <cstdint>
+#include <stdexcept>
+#include <algorithm>
+
+#include "matrix.hpp"
+#include "matrix_ops.hpp"
+#include "lut_utils.hpp"
+
+// =============================================================
+//  Structured-sparse int4 weights
+//  Block-CSR over K: each row keeps only its non-zero blocks of
+//  `block_k` consecutive weights (row_ptr / block_col), so
+//  all-zero blocks cost neither bandwidth nor table lookups.
+//  When every group of 4 weights has at most 2 non-zeros (2:4
+//  sparsity) the stored blocks are compressed further: 2 nibbles
+//  plus two 2-bit positions per group, i.e. 12 bits per 4 weights
+//  instead of 16 (plus a 16-bit block index per stored block).
+//  Values are two's-complement nibbles (0‥15), as in Int4Storage.
+// =============================================================
+
+struct SparseInt4Weights {
+    size_t rows = 0, cols = 0;
+    size_t block_k = 32;            // multiple of 8, at most 256
+    bool two_four = false;          // blocks stored 2:4-compressed
+    std::vector<uint32_t> row_ptr;   // rows + 1 offsets into block_col
+    std::vector<uint16_t> block_col; // K-block index of each stored block
+    std::vector<uint8_t> values;     // packed nibbles, value_bytes() per block
+    std::vector<uint8_t> meta;       // 2:4 only, meta_bytes() per block
+
+    size_t num_k_blocks() const noexcept { return (cols + block_k - 1) / block_k; }
+    size_t stored_blocks() const noexcept { return block_col.size(); }
+    size_t value_bytes() const noexcept { return two_four ? block_k / 4 : block_k / 2; }
+    size_t meta_bytes() const noexcept { return two_four ? block_k / 8 : 0; }
+    size_t size_bytes() const noexcept {
+        return values.size() + meta.size()
+             + row_ptr.size() * sizeof(uint32_t) + block_col.size() * sizeof(uint16_t);
+    }
+
+    // Expands stored block b into block_k nibbles (zeros where pruned)
+    void decode_block(size_t b, uint8_t* out) const noexcept {
+        const uint8_t* v = &values[b * value_bytes()];
+        if (!two_four) {
+            for (size_t i = 0; i < block_k; i += 2) {
+                out[i]     = v[i / 2] & 0x0F;
+                out[i + 1] = v[i / 2] >> 4;
+            }
+            return;
+        }
+        const uint8_t* m = &meta[b * meta_bytes()];
+        std::fill(out, out + block_k, uint8_t(0));
+        for (size_t g = 0; g < block_k / 4; ++g) {
+            uint8_t pos = (m[g / 2] >> ((g & 1) * 4)) & 0x0F;   // p0 | p1 << 2
+            out[g * 4 + (pos & 3)]        = v[g] & 0x0F;
+            out[g * 4 + ((pos >> 2) & 3)] = v[g] >> 4;
+        }
+    }
+
+    // Non-zero entries of stored block b as (offset in block, nibble)
+    // pairs; returns their count. Compaction is branch-free.
+    size_t decode_nonzeros(size_t b, uint8_t* offset, uint8_t* nibble) const noexcept {
+        const uint8_t* v = &values[b * value_bytes()];
+        size_t n = 0;
+        if (!two_four) {
+            for (size_t i = 0; i < block_k; ++i) {
+                uint8_t q = (v[i / 2] >> ((i & 1) * 4)) & 0x0F;
+                offset[n] = uint8_t(i); nibble[n] = q; n += (q != 0);
+            }
+            return n;
+        }
+        const uint8_t* m = &meta[b * meta_bytes()];
+        for (size_t g = 0; g < block_k / 4; ++g) {
+            uint8_t pos = (m[g / 2] >> ((g & 1) * 4)) & 0x0F;
+            uint8_t q0 = v[g] & 0x0F, q1 = v[g] >> 4;
+            offset[n] = uint8_t(g * 4 + (pos & 3));        nibble[n] = q0; n += (q0 != 0);
+            offset[n] = uint8_t(g * 4 + ((pos >> 2) & 3)); nibble[n] = q1; n += (q1 != 0);
+        }
+        return n;
+    }
+
+    // Dense unpacked nibbles (rows × cols), mainly for verification
+    std::vector<uint8_t> to_dense() const {
+        std::vector<uint8_t> W(rows * cols, 0);
+        std::vector<uint8_t> blk(block_k);
+        for (size_t r = 0; r < rows; ++r)
+            for (size_t b = row_ptr[r]; b < row_ptr[r + 1]; ++b) {
+                decode_block(b, blk.data());
+                size_t k0 = size_t(block_col[b]) * block_k;
+                size_t len = std::min(block_k, cols - k0);
+                std::copy(blk.begin(), blk.begin() + len, &W[r * cols + k0]);
+            }
+        return W;
+    }
+};
+
+// Converts unpacked nibbles (M × K, one per byte) to the sparse format.
+// 2:4 compression is used automatically when the whole matrix allows it.
+inline SparseInt4Weights sparsify_int4(const uint8_t* W, size_t M, size_t K,
+                                       size_t block_k = 32)
+{
+    if (block_k == 0 || block_k % 8 != 0 || block_k > 256)
+        throw std::invalid_argument("block_k must be a multiple of 8 in [8, 256]");
+    SparseInt4Weights S;
+    S.rows = M; S.cols = K; S.block_k = block_k;
+
+    auto at = [&](size_t r, size_t k) -> uint8_t { return k < K ? (W[r * K + k] & 0x0F) : 0; };
+    const size_t nb = S.num_k_blocks();
+    if (nb > 0xFFFF) throw std::invalid_argument("K / block_k exceeds 65535 blocks");
+
+    S.two_four = true;
+    for (size_t r = 0; r < M && S.two_four; ++r)
+        for (size_t g = 0; g < nb * block_k; g += 4) {
+            int nz = (at(r, g) != 0) + (at(r, g + 1) != 0) + (at(r, g + 2) != 0) + (at(r, g + 3) != 0);
+            if (nz > 2) { S.two_four = false; break; }
+        }
+
+    S.row_ptr.push_back(0);
+    for (size_t r = 0; r < M; ++r) {
+        for (size_t b = 0; b < nb; ++b) {
+            size_t k0 = b * block_k;
+            bool any = false;
+            for (size_t k = k0; k < k0 + block_k && !any; ++k) any = at(r, k) != 0;
+            if (!any) continue;
+            S.block_col.push_back(uint16_t(b));
+            if (!S.two_four) {
+                for (size_t k = k0; k < k0 + block_k; k += 2)
+                    S.values.push_back(uint8_t(at(r, k) | (at(r, k + 1) << 4)));
+                continue;
+            }
+            size_t meta_base = S.meta.size();
+            S.meta.resize(meta_base + S.meta_bytes(), 0);
+            for (size_t g = 0; g < block_k / 4; ++g) {
+                uint8_t pos[2] = {0, 1}, val[2] = {0, 0};
+                int n = 0;
+                for (uint8_t p = 0; p < 4 && n < 2; ++p)
+                    if (at(r, k0 + g * 4 + p)) { pos[n] = p; val[n] = at(r, k0 + g * 4 + p); ++n; }
+                if (n == 1 && pos[0] == 1) pos[1] = 0;   // keep the two positions distinct
+                S.values.push_back(uint8_t(val[0] | (val[1] << 4)));
+                S.meta[meta_base + g / 2] |= uint8_t((pos[0] | (pos[1] << 2)) << ((g & 1) * 4));
+            }
+        }
+        S.row_ptr.push_back(uint32_t(S.block_col.size()));
+    }
+    return S;
+}
+
+// Converts from the dense packed storage
+inline SparseInt4Weights sparsify_int4(const Matrix<uint8_t, RowMajor, Int4Storage>& W,
+                                       size_t block_k = 32)
+{
+    std::vector<uint8_t> u = unpack_int4(W);
+    return sparsify_int4(u.data(), W.rows(), W.cols(), block_k);
+}
+
+// =============================================================
+//  Zero-skipping LUT GEMM — same contract as matmul_lut_fast
+//  (A: K × N unpacked nibbles / ints, C: M × N int32).
+//  Per tile, K-blocks stored by none of the tile's rows are skipped
+//  entirely (no table fills). For the others, one table per k of
+//  the block is built, then each row walks only its non-zero
+//  (offset, nibble) pairs — pruned weights cost no lookups and no
+//  mispredicted branches.
+// =============================================================
+
+template <typename A>
+auto matmul_lut_sparse(const SparseInt4Weights& W,
+                       const std::vector<A>& A_mat,
+                       size_t N,
+                       const ProductLookupTable<uint8_t, A, int32_t>& lut,
+                       size_t num_threads = 4)
+{
+    using Table = ProductLookupTable<uint8_t, A, int32_t>;
+    const size_t M = W.rows, K = W.cols, BK = W.block_k;
+    Matrix<int32_t, RowMajor, PlainStorage<int32_t>> C(M, N);
+    int32_t* Cd = C.data();
+    const size_t levels = lut.weight_levels();
+    const bool mirror = lut.mirrored();
+    // block tables scale with BK × NC: keep panels narrower than the dense kernel
+    const TileShape shape = choose_tile_shape(M, N, num_threads, {128, 64}, 64);
+    const size_t width = std::min(shape.nc, N);
+
+    struct Worker {
+        std::vector<Table> luts;        // one per k of the current block
+        std::vector<size_t> cursor;     // next stored block of each tile row
+        std::vector<uint8_t> offset, nibble;
+        std::vector<const int32_t*> rows;   // table row of each non-zero
+        std::vector<int32_t> signs;
+        size_t  q_row[16];                  // nibble -> offset of its table row
+        int32_t q_sign[16];                 // nibble -> ±1 (mirror mode)
+    };
+
+    parallel_for_tiles(M, N, shape, num_threads,
+        [&](size_t) {
+            Worker wk;
+            wk.luts.reserve(BK);
+            for (size_t i = 0; i < BK; ++i) wk.luts.emplace_back(levels, width, mirror);
+            wk.offset.resize(BK);
+            wk.nibble.resize(BK);
+            wk.rows.resize(BK);
+            wk.signs.resize(BK);
+            for (size_t q = 0; q < 16; ++q) {
+                const Table& t = wk.luts.front();
+                wk.q_row[q]  = q < levels ? t.stored_row(q) * t.row_stride() : 0;
+                wk.q_sign[q] = (mirror && t.is_negative(q)) ? -1 : 1;
+            }
+            return wk;
+        },
+        [&](const Tile& tile, Worker& wk) {
+            const size_t cols = tile.cols();
+            wk.cursor.resize(tile.rows());
+            for (size_t r = 0; r < tile.rows(); ++r) wk.cursor[r] = W.row_ptr[tile.m0 + r];
+
+            for (size_t kb = 0; kb < W.num_k_blocks(); ++kb) {
+                const size_t k0 = kb * BK, k1 = std::min(k0 + BK, K);
+                bool filled = false;
+                for (size_t r = 0; r < tile.rows(); ++r) {
+                    size_t b = wk.cursor[r];
+                    if (b >= W.row_ptr[tile.m0 + r + 1] || W.block_col[b] != kb) continue;
+                    ++wk.cursor[r];
+                    if (!filled) {   // first row holding this block: build its tables
+                        TraceScope span("lut_build", "lut", "k0", int64_t(k0), "k1", int64_t(k1));
+                        for (size_t k = k0; k < k1; ++k)
+                            wk.luts[k - k0].fill_from_activation(&A_mat[k * N + tile.n0], cols);
+                        filled = true;
+                    }
+                    int32_t* c_row = Cd + (tile.m0 + r) * N + tile.n0;
+                    size_t nnz = W.decode_nonzeros(b, wk.offset.data(), wk.nibble.data());
+                    // per-nibble row offsets / signs are table lookups too: weight
+                    // signs are data-dependent, so branching on them mispredicts
+                    for (size_t e = 0; e < nnz; ++e) {
+                        uint8_t q = wk.nibble[e];
+                        wk.rows[e]  = wk.luts[wk.offset[e]].data() + wk.q_row[q];
+                        wk.signs[e] = wk.q_sign[q];
+                    }
+                    if (cols < 8) {
+                        // narrow (GEMV) tiles: sum in a register, no store-to-load chain on c_row
+                        for (size_t j = 0; j < cols; ++j) {
+                            int32_t acc = 0;
+                            for (size_t e = 0; e < nnz; ++e) acc += wk.signs[e] * wk.rows[e][j];
+                            c_row[j] += acc;
+                        }
+                    } else {
+                        for (size_t e = 0; e < nnz; ++e) {
+                            const int32_t* lut_row = wk.rows[e];
+                            const int32_t sgn = wk.signs[e];
+                            for (size_t j = 0; j < cols; ++j) c_row[j] += sgn * lut_row[j];
+                        }
+                    }
+                }
+            }
+        });
+    return C;
+}
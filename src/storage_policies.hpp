@@ -1,6 +1,10 @@
 #pragma once
 #include <cstdint>   // for uint8_t
 #include <cstddef>   // for size_t
+#include <cstring>   // std::memcpy
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#include <immintrin.h>
+#endif
 
 template<typename T>
 struct PlainStorage {
@@ -21,3 +25,145 @@ struct Int4Storage {
         else             b = (b & 0x0F) | ((v & 0x0F) << 4);
     }
 };
+
+// =============================================================
+//  IEEE 754 binary16 ("half") storage
+//  fp16_t is a 2-byte bit container, layout-compatible with
+//  numpy.float16 / _Float16. Scalar conversions are portable
+//  software; bulk row conversions use F16C (vcvtph2ps /
+//  vcvtps2ph, 8 lanes) when the CPU reports it at runtime.
+// =============================================================
+
+struct fp16_t {
+    uint16_t bits = 0;
+};
+
+inline float fp16_to_float(fp16_t h) {
+    uint32_t sign = uint32_t(h.bits & 0x8000u) << 16;
+    uint32_t exp  = (h.bits >> 10) & 0x1Fu;
+    uint32_t man  = h.bits & 0x3FFu;
+    uint32_t f;
+    if (exp == 0x1Fu) {                       // inf / nan
+        f = sign | 0x7F800000u | (man << 13);
+    } else if (exp != 0) {                    // normal
+        f = sign | ((exp + 112) << 23) | (man << 13);
+    } else if (man == 0) {                    // ±0
+        f = sign;
+    } else {                                  // subnormal: renormalize
+        int e = -1;
+        do { ++e; man <<= 1; } while ((man & 0x400u) == 0);
+        f = sign | (uint32_t(112 - e) << 23) | ((man & 0x3FFu) << 13);
+    }
+    float out;
+    std::memcpy(&out, &f, sizeof(out));
+    return out;
+}
+
+// Round-to-nearest-even, overflow to ±inf, NaN stays NaN
+inline fp16_t float_to_fp16(float v) {
+    uint32_t f;
+    std::memcpy(&f, &v, sizeof(f));
+    uint16_t sign = uint16_t((f >> 16) & 0x8000u);
+    uint32_t absf = f & 0x7FFFFFFFu;
+    fp16_t h;
+    if (absf >= 0x7F800000u) {                // inf / nan
+        h.bits = sign | 0x7C00u | (absf > 0x7F800000u ? 0x200u : 0u);
+    } else if (absf >= 0x477FF000u) {         // rounds past 65504
+        h.bits = sign | 0x7C00u;
+    } else if (absf < 0x38800000u) {          // half subnormal or zero
+        if (absf < 0x33000000u) { h.bits = sign; return h; }
+        uint32_t exp   = absf >> 23;
+        uint32_t man   = (absf & 0x7FFFFFu) | 0x800000u;
+        uint32_t shift = 126 - exp;           // 14 … 24
+        uint32_t half  = man >> shift;
+        uint32_t rem   = man & ((1u << shift) - 1);
+        uint32_t mid   = 1u << (shift - 1);
+        if (rem > mid || (rem == mid && (half & 1u))) ++half;
+        h.bits = sign | uint16_t(half);
+    } else {
+        uint32_t half = ((absf >> 13) - (112u << 10));
+        uint32_t rem  = absf & 0x1FFFu;
+        if (rem > 0x1000u || (rem == 0x1000u && (half & 1u))) ++half;
+        h.bits = sign | uint16_t(half);
+    }
+    return h;
+}
+
+inline bool cpu_has_f16c() {
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+    static const bool has = __builtin_cpu_supports("f16c") && __builtin_cpu_supports("avx");
+    return has;
+#else
+    return false;
+#endif
+}
+
+namespace detail {
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+__attribute__((target("avx,f16c")))
+inline size_t fp16_to_f32_f16c(const fp16_t* src, float* dst, size_t n) {
+    size_t i = 0;
+    for (; i + 8 <= n; i += 8) {
+        __m128i h = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + i));
+        _mm256_storeu_ps(dst + i, _mm256_cvtph_ps(h));
+    }
+    return i;
+}
+
+__attribute__((target("avx,f16c")))
+inline size_t f32_to_fp16_f16c(const float* src, fp16_t* dst, size_t n) {
+    size_t i = 0;
+    for (; i + 8 <= n; i += 8) {
+        __m128i h = _mm256_cvtps_ph(_mm256_loadu_ps(src + i), _MM_FROUND_TO_NEAREST_INT);
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + i), h);
+    }
+    return i;
+}
+#endif
+} // namespace detail
+
+// Bulk conversions; the scalar tail (or whole span without F16C)
+// uses the software path, which rounds identically.
+inline void fp16_to_float(const fp16_t* src, float* dst, size_t n) {
+    size_t i = 0;
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+    if (cpu_has_f16c()) i = detail::fp16_to_f32_f16c(src, dst, n);
+#endif
+    for (; i < n; ++i) dst[i] = fp16_to_float(src[i]);
+}
+
+inline void float_to_fp16(const float* src, fp16_t* dst, size_t n) {
+    size_t i = 0;
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+    if (cpu_has_f16c()) i = detail::f32_to_fp16_f16c(src, dst, n);
+#endif
+    for (; i < n; ++i) dst[i] = float_to_fp16(src[i]);
+}
+
+// Matrix<float, Layout, FP16Storage>: float interface, 2-byte storage
+struct FP16Storage {
+    using StorageType = fp16_t;
+    static constexpr size_t entries_per_unit = 1;
+    static float get(const StorageType &unit, size_t /*offset*/) { return fp16_to_float(unit); }
+    static void set(StorageType &unit, float value, size_t /*offset*/) { unit = float_to_fp16(value); }
+};
+
+namespace detail {
+inline float to_float(float v) { return v; }
+inline float to_float(fp16_t h) { return fp16_to_float(h); }
+
+// Row of n activations as floats: float rows are used in place,
+// half rows are widened into `scratch` (≥ n floats).
+inline const float* row_as_float(const float* src, size_t, float*) { return src; }
+inline const float* row_as_float(const fp16_t* src, size_t n, float* scratch) {
+    fp16_to_float(src, scratch, n);
+    return scratch;
+}
+// Stores n floats into a float or half destination row
+inline void store_row(const float* src, float* dst, size_t n) {
+    std::memcpy(dst, src, n * sizeof(float));
+}
+inline void store_row(const float* src, fp16_t* dst, size_t n) {
+    float_to_fp16(src, dst, n);
+}
+} // namespace detail
@@ -0,0 +1,73 @@
+#pragma once
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <utility>
+
+// =============================================================
+//  SerialExecutor — one worker thread running posted tasks in
+//  FIFO order. Chaining two executors gives a two-stage pipeline:
+//  stage 1 of call n+1 overlaps stage 2 of call n, while each
+//  stage still sees calls in submission order.
+//  The destructor drains every queued task before joining.
+//  Tasks must not throw; report failures through their own
+//  promise/callback instead.
+// =============================================================
+class SerialExecutor {
+public:
+    SerialExecutor() : worker_([this] { run(); }) {}
+
+    SerialExecutor(const SerialExecutor&) = delete;
+    SerialExecutor& operator=(const SerialExecutor&) = delete;
+
+    ~SerialExecutor() {
+        {
+            std::lock_guard<std::mutex> lock(mtx_);
+            stop_ = true;
+        }
+        cv_.notify_all();
+        worker_.join();
+    }
+
+    void post(std::function<void()> task) {
+        {
+            std::lock_guard<std::mutex> lock(mtx_);
+            tasks_.push_back(std::move(task));
+        }
+        cv_.notify_one();
+    }
+
+    // Tasks queued or running
+    size_t pending() const {
+        std::lock_guard<std::mutex> lock(mtx_);
+        return tasks_.size() + (busy_ ? 1 : 0);
+    }
+
+private:
+    mutable std::mutex mtx_;
+    std::condition_variable cv_;
+    std::deque<std::function<void()>> tasks_;
+    bool stop_ = false;
+    bool busy_ = false;
+    std::thread worker_;   // last: started once the queue state exists
+
+    void run() {
+        for (;;) {
+            std::function<void()> task;
+            {
+                std::unique_lock<std::mutex> lock(mtx_);
+                cv_.wait(lock, [this] { return stop_ || !tasks_.empty(); });
+                if (tasks_.empty()) return;        // stop_ and fully drained
+                task = std::move(tasks_.front());
+                tasks_.pop_front();
+                busy_ = true;
+            }
+            task();
+            std::lock_guard<std::mutex> lock(mtx_);
+            busy_ = false;
+        }
+    }
+};
@@ -0,0 +1,128 @@
+#pragma once
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <thread>
+#include <vector>
+
+#include "numa_utils.hpp"
+#include "trace.hpp"
+
+// =============================================================
+//  2D tile scheduler — the output C (M × N) is cut into MC × NC
+//  tiles that workers claim dynamically from an atomic counter,
+//  so uneven shapes no longer leave the last thread idle and
+//  wide-N outputs are split across threads too.
+//
+//  Tile order is grouped: `group_m` row bands are walked column
+//  panel by column panel. Tiles claimed at the same time share
+//  the activation panel (and hence the LUT inputs) while the
+//  weight bands of the group stay hot in the shared L2/L3 for
+//  the next panel.
+// =============================================================
+
+struct Tile {
+    size_t m0 = 0, m1 = 0;   // rows    [m0, m1)
+    size_t n0 = 0, n1 = 0;   // columns [n0, n1)
+    size_t rows() const noexcept { return m1 - m0; }
+    size_t cols() const noexcept { return n1 - n0; }
+};
+
+struct TileShape {
+    size_t mc = 64, nc = 256;
+};
+
+// Default tile shape: shrinks MC (down to min_mc), then NC, until
+// every thread can get a couple of tiles to balance load. LUT kernels
+// pass a larger min_mc: each tile rebuilds its table per K step, so
+// short tiles pay more table fills per output row.
+inline TileShape choose_tile_shape(size_t M, size_t N, size_t num_threads,
+                                   TileShape base = {}, size_t min_mc = 8)
+{
+    TileShape s = base;
+    auto tiles = [&] { return ((M + s.mc - 1) / s.mc) * ((N + s.nc - 1) / s.nc); };
+    const size_t want = 2 * std::max<size_t>(1, num_threads);
+    while (tiles() < want && s.mc / 2 >= min_mc) s.mc /= 2;
+    while (tiles() < want && s.nc > 32) s.nc /= 2;
+    return s;
+}
+
+class TileScheduler {
+public:
+    TileScheduler(size_t M, size_t N, TileShape shape, size_t group_m = 8)
+      : M_(M), N_(N), shape_(shape),
+        bands_((M + shape.mc - 1) / shape.mc),
+        panels_((N + shape.nc - 1) / shape.nc),
+        group_m_(std::max<size_t>(1, group_m)) {}
+
+    TileScheduler(const TileScheduler&) = delete;
+    TileScheduler& operator=(const TileScheduler&) = delete;
+
+    size_t num_tiles() const noexcept { return bands_ * panels_; }
+    const TileShape& shape() const noexcept { return shape_; }
+
+    // idx-th tile in grouped order
+    Tile tile(size_t idx) const noexcept {
+        const size_t per_group = group_m_ * panels_;
+        const size_t g = idx / per_group, r = idx % per_group;
+        const size_t band0 = g * group_m_;
+        const size_t gsize = std::min(group_m_, bands_ - band0);
+        const size_t band  = band0 + r % gsize;
+        const size_t panel = r / gsize;
+        Tile t;
+        t.m0 = band * shape_.mc;  t.m1 = std::min(t.m0 + shape_.mc, M_);
+        t.n0 = panel * shape_.nc; t.n1 = std::min(t.n0 + shape_.nc, N_);
+        return t;
+    }
+
+    // Claims the next tile; false once all tiles are handed out
+    bool next(Tile& out) noexcept {
+        size_t idx = next_.fetch_add(1, std::memory_order_relaxed);
+        if (idx >= num_tiles()) return false;
+        out = tile(idx);
+        return true;
+    }
+
+    void reset() noexcept { next_.store(0, std::memory_order_relaxed); }
+
+private:
+    size_t M_, N_;
+    TileShape shape_;
+    size_t bands_, panels_, group_m_;
+    std::atomic<size_t> next_{0};
+};
+
+// Runs body(tile, state) over every tile of the M × N output on up
+// to num_threads workers. `state = init(worker)` is created once per
+// worker before its first tile (e.g. a per-worker LUT).
+template<typename Init, typename Body>
+void parallel_for_tiles(size_t M, size_t N, TileShape shape,
+                        size_t num_threads, Init init, Body body)
+{
+    TileScheduler sched(M, N, shape);
+    const size_t workers = std::max<size_t>(1, std::min(num_threads, sched.num_tiles()));
+    auto run = [&](size_t w) {
+        TraceScope span("worker", "sched", "worker", int64_t(w));
+        auto state = init(w);
+        Tile t;
+        while (sched.next(t)) {
+            TraceScope tile_span("tile", "sched", "m0", int64_t(t.m0), "n0", int64_t(t.n0));
+            body(t, state);
+        }
+    };
+    if (workers == 1) { run(0); return; }   // inline: caller's affinity untouched
+    std::vector<std::thread> threads;
+    for (size_t w = 0; w < workers; ++w)
+        threads.emplace_back([&, w]() { maybe_pin_worker(w); run(w); });
+    for (auto& thr : threads) thr.join();
+}
+
+// Stateless variant: body(tile)
+template<typename Body>
+void parallel_for_tiles(size_t M, size_t N, TileShape shape,
+                        size_t num_threads, Body body)
+{
+    parallel_for_tiles(M, N, shape, num_threads,
+                       [](size_t) { return 0; },
+                       [&](const Tile& t, int&) { body(t); });
+}
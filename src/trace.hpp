@@ -0,0 +1,206 @@
+#pragma once
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <fstream>
+#include <memory>
+#include <mutex>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+// =============================================================
+//  Execution tracer (Chrome / Perfetto trace format)
+//  Opt-in: set_tracing(true) starts recording begin/end spans of
+//  worker runs, tiles, LUT builds, split-K slices, merges and
+//  engine phases. Each thread appends to its own ring buffer (no
+//  locks or shared atomics on the record path; the oldest events
+//  are overwritten when full). When tracing is off a TraceScope
+//  costs one relaxed atomic load.
+//  trace_json() / write_trace() dump all rings as a JSON object
+//  loadable by chrome://tracing or ui.perfetto.dev; call them
+//  while no GEMM is running.
+//  Rings of exited threads are handed to new threads (GEMM calls
+//  spawn fresh workers), so memory stays bounded by the number of
+//  concurrently live threads; every thread gets a new trace tid.
+// =============================================================
+
+struct TraceEvent {
+    const char* name = nullptr;     // string literals only
+    const char* cat  = nullptr;
+    uint64_t begin_ns = 0, end_ns = 0;
+    uint32_t tid = 0;
+    const char* arg_name[2] = {nullptr, nullptr};
+    int64_t     arg[2]      = {0, 0};
+};
+
+namespace detail {
+
+inline uint64_t trace_now_ns() {
+    static const auto base = std::chrono::steady_clock::now();
+    return uint64_t(std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now() - base).count());
+}
+
+// Single-writer ring: only the owning thread pushes; dumps read
+// `head` with acquire ordering.
+struct TraceRing {
+    std::vector<TraceEvent> events;
+    std::atomic<uint64_t> head{0};
+    uint32_t tid = 0;
+
+    explicit TraceRing(size_t capacity) : events(capacity) {}
+
+    void push(const TraceEvent& e) noexcept {
+        uint64_t h = head.load(std::memory_order_relaxed);
+        events[h % events.size()] = e;
+        head.store(h + 1, std::memory_order_release);
+    }
+};
+
+struct TraceRegistry {
+    std::mutex mtx;
+    std::vector<std::unique_ptr<TraceRing>> rings;
+    std::vector<TraceRing*> free_rings;
+    std::atomic<bool> enabled{false};
+    size_t capacity = size_t(1) << 15;
+    uint32_t next_tid = 1;
+
+    TraceRing* acquire() {
+        std::lock_guard<std::mutex> lk(mtx);
+        TraceRing* r;
+        if (!free_rings.empty()) { r = free_rings.back(); free_rings.pop_back(); }
+        else { rings.push_back(std::make_unique<TraceRing>(capacity)); r = rings.back().get(); }
+        r->tid = next_tid++;
+        return r;
+    }
+    void release(TraceRing* r) {
+        std::lock_guard<std::mutex> lk(mtx);
+        free_rings.push_back(r);
+    }
+};
+
+inline TraceRegistry& trace_registry() {
+    static TraceRegistry reg;
+    return reg;
+}
+
+// Per-thread ring, taken from the registry on first use
+struct TraceThreadRing {
+    TraceRing* ring = nullptr;
+    ~TraceThreadRing() { if (ring) trace_registry().release(ring); }
+    TraceRing& get() {
+        if (!ring) ring = trace_registry().acquire();
+        return *ring;
+    }
+};
+
+inline TraceRing& this_thread_ring() {
+    thread_local TraceThreadRing r;
+    return r.get();
+}
+
+} // namespace detail
+
+// Enables / disables recording. `ring_capacity` (events per thread)
+// applies to rings created after the call.
+inline void set_tracing(bool enable, size_t ring_capacity = 0) {
+    auto& reg = detail::trace_registry();
+    if (ring_capacity) {
+        std::lock_guard<std::mutex> lk(reg.mtx);
+        reg.capacity = ring_capacity;
+    }
+    detail::trace_now_ns();   // pin the time base before the first event
+    reg.enabled.store(enable, std::memory_order_relaxed);
+}
+
+inline bool tracing_enabled() noexcept {
+    return detail::trace_registry().enabled.load(std::memory_order_relaxed);
+}
+
+// Records one complete span for the calling thread
+inline void trace_record(TraceEvent e) {
+    detail::TraceRing& r = detail::this_thread_ring();
+    e.tid = r.tid;
+    r.push(e);
+}
+
+// RAII span: records [construction, destruction) when tracing is on.
+// Up to two integer arguments (e.g. tile coordinates) are attached.
+class TraceScope {
+public:
+    TraceScope(const char* name, const char* cat,
+               const char* k0 = nullptr, int64_t v0 = 0,
+               const char* k1 = nullptr, int64_t v1 = 0) noexcept
+      : active_(tracing_enabled())
+    {
+        if (!active_) return;
+        ev_.name = name; ev_.cat = cat;
+        ev_.arg_name[0] = k0; ev_.arg[0] = v0;
+        ev_.arg_name[1] = k1; ev_.arg[1] = v1;
+        ev_.begin_ns = detail::trace_now_ns();
+    }
+    ~TraceScope() {
+        if (!active_) return;
+        ev_.end_ns = detail::trace_now_ns();
+        trace_record(ev_);
+    }
+    TraceScope(const TraceScope&) = delete;
+    TraceScope& operator=(const TraceScope&) = delete;
+
+private:
+    bool active_;
+    TraceEvent ev_;
+};
+
+// All buffered events, oldest first per thread
+inline std::vector<TraceEvent> trace_events() {
+    auto& reg = detail::trace_registry();
+    std::lock_guard<std::mutex> lk(reg.mtx);
+    std::vector<TraceEvent> out;
+    for (auto& r : reg.rings) {
+        const uint64_t h = r->head.load(std::memory_order_acquire);
+        const uint64_t cap = r->events.size();
+        for (uint64_t i = h > cap ? h - cap : 0; i < h; ++i) out.push_back(r->events[i % cap]);
+    }
+    return out;
+}
+
+// Drops all buffered events
+inline void clear_trace() {
+    auto& reg = detail::trace_registry();
+    std::lock_guard<std::mutex> lk(reg.mtx);
+    for (auto& r : reg.rings) r->head.store(0, std::memory_order_relaxed);
+}
+
+// Chrome trace JSON ("X" complete events, timestamps in µs)
+inline std::string trace_json() {
+    std::ostringstream os;
+    os.setf(std::ios::fixed);
+    os.precision(3);
+    os << "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[";
+    bool first = true;
+    for (const TraceEvent& e : trace_events()) {
+        os << (first ? "" : ",") << "\n{\"name\":\"" << e.name << "\",\"cat\":\"" << e.cat
+           << "\",\"ph\":\"X\",\"pid\":1,\"tid\":" << e.tid
+           << ",\"ts\":" << double(e.begin_ns) * 1e-3
+           << ",\"dur\":" << double(e.end_ns - e.begin_ns) * 1e-3;
+        if (e.arg_name[0]) {
+            os << ",\"args\":{\"" << e.arg_name[0] << "\":" << e.arg[0];
+            if (e.arg_name[1]) os << ",\"" << e.arg_name[1] << "\":" << e.arg[1];
+            os << "}";
+        }
+        os << "}";
+        first = false;
+    }
+    os << "\n]}\n";
+    return os.str();
+}
+
+inline void write_trace(const std::string& path) {
+    std::ofstream f(path);
+    if (!f) throw std::runtime_error("cannot open trace file: " + path);
+    f << trace_json();
+}
@@ -0,0 +1,167 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+
+// =============================================================
+//  Content-keyed LRU cache of packed weights
+//  Callers that pass the same weight array every step (Python
+//  lists arrive as fresh std::vector copies, so addresses mean
+//  nothing) are recognised by content: a 64-bit hash of the raw
+//  nibbles plus the shape selects a bucket, and a byte compare
+//  against the stored source confirms the hit, so a hash
+//  collision can never return the wrong weights.
+//  Each entry is charged for its source copy plus the packed
+//  form's `bytes`; least recently used entries are evicted to
+//  stay within the budget. Values are shared_ptr<const V>, so an
+//  evicted entry stays alive for calls still using it.
+// =============================================================
+
+struct WeightCacheStats {
+    uint64_t hits = 0, misses = 0, evictions = 0;
+    size_t entries = 0;
+    size_t bytes = 0;           // charged bytes currently held
+    size_t budget_bytes = 0;    // 0 = cache disabled
+};
+
+struct WeightKey {
+    int M = 0, K = 0;
+    bool trans_w = false;
+    int bits = 4;   // weight bit width the codes are packed as
+    bool numa = false;   // packed as node-local slices
+};
+
+namespace detail {
+
+// 8 bytes per step; only needs to spread distinct weight arrays
+inline uint64_t hash_bytes(const uint8_t* p, size_t n) noexcept {
+    uint64_t h = 0x9E3779B97F4A7C15ull ^ n;
+    size_t i = 0;
+    for (; i + 8 <= n; i += 8) {
+        uint64_t w;
+        std::memcpy(&w, p + i, 8);
+        h = (h ^ w) * 0xFF51AFD7ED558CCDull;
+        h ^= h >> 32;
+    }
+    for (; i < n; ++i) h = (h ^ p[i]) * 0x100000001B3ull;
+    return h ^ (h >> 29);
+}
+
+} // namespace detail
+
+template <typename V>
+class WeightCache {
+public:
+    explicit WeightCache(size_t budget_bytes = 0) : budget_(budget_bytes) {}
+
+    void set_budget(size_t budget_bytes) {
+        std::lock_guard<std::mutex> lk(mtx_);
+        budget_ = budget_bytes;
+        evict_to(budget_);
+    }
+    // Turns a disabled cache on; an existing budget is kept
+    void set_budget_if_off(size_t budget_bytes) {
+        std::lock_guard<std::mutex> lk(mtx_);
+        if (budget_ == 0) budget_ = budget_bytes;
+    }
+    bool enabled() const {
+        std::lock_guard<std::mutex> lk(mtx_);
+        return budget_ != 0;
+    }
+
+    // Cached value for (W, key), or pack(W) inserted under the budget.
+    // pack runs outside the lock; `bytes_of(v)` sizes the packed form.
+    template <typename Pack, typename Size>
+    std::shared_ptr<const V> get_or_pack(const std::vector<uint8_t>& W, const WeightKey& key,
+                                         Pack&& pack, Size&& bytes_of)
+    {
+        if (!enabled()) return std::make_shared<const V>(pack());   // no hashing when off
+        const uint64_t h = detail::hash_bytes(W.data(), W.size())
+                         ^ (uint64_t(uint32_t(key.M)) << 33) ^ (uint64_t(uint32_t(key.K)) << 1)
+                         ^ uint64_t(key.trans_w) ^ (uint64_t(key.bits) << 2)
+                         ^ (uint64_t(key.numa) << 5);
+        {
+            std::lock_guard<std::mutex> lk(mtx_);
+            if (auto v = lookup(h, W, key)) { ++hits_; return v; }
+            ++misses_;
+        }
+
+        auto v = std::make_shared<const V>(pack());
+        const size_t charge = W.size() + bytes_of(*v);
+
+        std::lock_guard<std::mutex> lk(mtx_);
+        if (charge > budget_) return v;               // never fits: serve uncached
+        if (lookup(h, W, key)) return v;              // another thread inserted it meanwhile
+        evict_to(budget_ - charge);
+        lru_.push_front(Entry{h, key, W, v, charge});
+        index_.emplace(h, lru_.begin());
+        bytes_ += charge;
+        return v;
+    }
+
+    void clear() {
+        std::lock_guard<std::mutex> lk(mtx_);
+        lru_.clear();
+        index_.clear();
+        bytes_ = 0;
+    }
+
+    WeightCacheStats stats() const {
+        std::lock_guard<std::mutex> lk(mtx_);
+        WeightCacheStats s;
+        s.hits = hits_; s.misses = misses_; s.evictions = evictions_;
+        s.entries = lru_.size();
+        s.bytes = bytes_;
+        s.budget_bytes = budget_;
+        return s;
+    }
+
+private:
+    struct Entry {
+        uint64_t hash;
+        WeightKey key;
+        std::vector<uint8_t> source;
+        std::shared_ptr<const V> value;
+        size_t charge;
+    };
+    using Iter = typename std::list<Entry>::iterator;
+
+    mutable std::mutex mtx_;
+    std::list<Entry> lru_;                         // most recent first
+    std::unordered_multimap<uint64_t, Iter> index_;
+    size_t budget_ = 0, bytes_ = 0;
+    uint64_t hits_ = 0, misses_ = 0, evictions_ = 0;
+
+    // caller holds mtx_; moves a hit to the front
+    std::shared_ptr<const V> lookup(uint64_t h, const std::vector<uint8_t>& W, const WeightKey& key) {
+        auto [b, e] = index_.equal_range(h);
+        for (auto it = b; it != e; ++it) {
+            Entry& en = *it->second;
+            if (en.key.M != key.M || en.key.K != key.K || en.key.trans_w != key.trans_w
+                || en.key.bits != key.bits || en.key.numa != key.numa) continue;
+            if (en.source.size() != W.size()
+                || std::memcmp(en.source.data(), W.data(), W.size()) != 0) continue;
+            lru_.splice(lru_.begin(), lru_, it->second);
+            return en.value;
+        }
+        return nullptr;
+    }
+
+    // caller holds mtx_
+    void evict_to(size_t limit) {
+        while (bytes_ > limit && !lru_.empty()) {
+            Iter last = std::prev(lru_.end());
+            auto [b, e] = index_.equal_range(last->hash);
+            for (auto it = b; it != e; ++it)
+                if (it->second == last) { index_.erase(it); break; }
+            bytes_ -= last->charge;
+            lru_.pop_back();
+            ++evictions_;
+        }
+    }
+};
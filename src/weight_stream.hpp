@@ -0,0 +1,227 @@
+#pragma once
+#include <vector>
+#include <string>
+#include <fstream>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <stdexcept>
+#include <algorithm>
+#include <limits>
+
+#ifdef __linux__
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#include "matrix.hpp"
+#include "matrix_ops.hpp"
+#include "lut_utils.hpp"
+#include "tile_scheduler.hpp"
+#include "trace.hpp"
+
+// =============================================================
+//  Out-of-core int4 weights
+//  Weight file: a 4 KiB header ("MPGEMMW4", rows, cols as
+//  little-endian u64) followed by rows of ceil(cols / 2) bytes,
+//  two nibbles per byte, low nibble first (the Int4Storage order
+//  within a row). Rows are padded independently so any row range
+//  is one contiguous byte range of the file.
+//
+//  MappedWeights maps the file read-only; matmul_lut_stream walks
+//  it in row panels: while panel p is unpacked and multiplied,
+//  panel p + 1 is requested with MADV_WILLNEED (kernel readahead),
+//  and panel p is dropped with MADV_DONTNEED afterwards, so at most
+//  two panels of the file are resident regardless of its size.
+// =============================================================
+
+constexpr size_t kWeightFileHeader = 4096;
+
+// Writes unpacked nibbles (M × K, one per byte) as a weight file
+inline void write_weight_file(const std::string& path, const uint8_t* W, size_t M, size_t K)
+{
+    std::ofstream f(path, std::ios::binary | std::ios::trunc);
+    if (!f) throw std::runtime_error("cannot create weight file: " + path);
+    std::vector<char> header(kWeightFileHeader, 0);
+    std::memcpy(header.data(), "MPGEMMW4", 8);
+    uint64_t dims[2] = {M, K};
+    std::memcpy(header.data() + 8, dims, sizeof(dims));
+    f.write(header.data(), header.size());
+
+    std::vector<uint8_t> row((K + 1) / 2);
+    for (size_t r = 0; r < M; ++r) {
+        std::fill(row.begin(), row.end(), uint8_t(0));
+        for (size_t k = 0; k < K; ++k)
+            row[k / 2] |= uint8_t((W[r * K + k] & 0x0F) << ((k & 1) * 4));
+        f.write(reinterpret_cast<const char*>(row.data()), row.size());
+    }
+    if (!f) throw std::runtime_error("failed writing weight file: " + path);
+}
+
+class MappedWeights {
+public:
+    explicit MappedWeights(const std::string& path) {
+#ifdef __linux__
+        fd_ = ::open(path.c_str(), O_RDONLY);
+        if (fd_ < 0) throw std::runtime_error("cannot open weight file: " + path);
+        struct stat st;
+        if (fstat(fd_, &st) != 0 || size_t(st.st_size) < kWeightFileHeader) {
+            ::close(fd_);
+            throw std::runtime_error("weight file too small: " + path);
+        }
+        size_ = size_t(st.st_size);
+        void* p = mmap(nullptr, size_, PROT_READ, MAP_SHARED, fd_, 0);
+        if (p == MAP_FAILED) {
+            ::close(fd_);
+            throw std::runtime_error("cannot map weight file: " + path);
+        }
+        base_ = static_cast<const uint8_t*>(p);
+        page_ = size_t(sysconf(_SC_PAGESIZE));
+        // access is sequential by panels; let the kernel read ahead
+        madvise(const_cast<uint8_t*>(base_), size_, MADV_SEQUENTIAL);
+#else
+        throw std::runtime_error("MappedWeights requires Linux mmap");
+#endif
+        if (std::memcmp(base_, "MPGEMMW4", 8) != 0) {
+            unmap();
+            throw std::runtime_error("not an mpGEMM int4 weight file: " + path);
+        }
+        uint64_t dims[2];
+        std::memcpy(dims, base_ + 8, sizeof(dims));
+        // dims come from the file: validate without forming rows × row_bytes
+        if (dims[0] == 0 || dims[1] == 0
+            || dims[0] > std::numeric_limits<size_t>::max()
+            || dims[1] >= std::numeric_limits<size_t>::max()) {
+            unmap();
+            throw std::runtime_error("bad weight file dimensions: " + path);
+        }
+        rows_ = size_t(dims[0]);
+        cols_ = size_t(dims[1]);
+        const size_t body = size_ - kWeightFileHeader;
+        if (row_bytes() > body || rows_ > body / row_bytes()) {
+            unmap();
+            throw std::runtime_error("truncated weight file: " + path);
+        }
+    }
+    ~MappedWeights() { unmap(); }
+    MappedWeights(const MappedWeights&) = delete;
+    MappedWeights& operator=(const MappedWeights&) = delete;
+
+    size_t rows() const noexcept { return rows_; }
+    size_t cols() const noexcept { return cols_; }
+    size_t row_bytes() const noexcept { return (cols_ + 1) / 2; }
+    const uint8_t* row(size_t r) const noexcept { return base_ + kWeightFileHeader + r * row_bytes(); }
+
+    // Asks the kernel to start reading rows [r0, r1)
+    void prefetch(size_t r0, size_t r1) const noexcept { advise(r0, r1, true); }
+    // Drops the page-cache mapping of rows [r0, r1) from this process
+    void release(size_t r0, size_t r1) const noexcept { advise(r0, r1, false); }
+
+    // Unpacks rows [r0, r1) into one nibble per byte
+    void unpack_rows(size_t r0, size_t r1, uint8_t* out) const noexcept {
+        for (size_t r = r0; r < r1; ++r) {
+            const uint8_t* src = row(r);
+            uint8_t* dst = out + (r - r0) * cols_;
+            for (size_t k = 0; k + 1 < cols_; k += 2) {
+                dst[k]     = src[k / 2] & 0x0F;
+                dst[k + 1] = src[k / 2] >> 4;
+            }
+            if (cols_ & 1) dst[cols_ - 1] = src[cols_ / 2] & 0x0F;
+        }
+    }
+
+private:
+    int fd_ = -1;
+    const uint8_t* base_ = nullptr;
+    size_t size_ = 0, page_ = 4096;
+    size_t rows_ = 0, cols_ = 0;
+
+    void advise(size_t r0, size_t r1, bool will_need) const noexcept {
+#ifdef __linux__
+        if (r1 <= r0) return;
+        size_t b0 = kWeightFileHeader + r0 * row_bytes();
+        size_t b1 = std::min(size_, kWeightFileHeader + r1 * row_bytes());
+        if (will_need) {
+            b0 -= b0 % page_;   // widen: whole range is requested
+        } else {
+            // shrink: pages shared with neighbouring panels stay mapped
+            b0 = (b0 + page_ - 1) / page_ * page_;
+            b1 -= b1 % page_;
+            if (b1 <= b0) return;
+        }
+        madvise(const_cast<uint8_t*>(base_) + b0, b1 - b0,
+                will_need ? MADV_WILLNEED : MADV_DONTNEED);
+#else
+        (void)r0; (void)r1; (void)will_need;
+#endif
+    }
+
+    void unmap() noexcept {
+#ifdef __linux__
+        if (base_) munmap(const_cast<uint8_t*>(base_), size_);
+        if (fd_ >= 0) ::close(fd_);
+#endif
+        base_ = nullptr;
+        fd_ = -1;
+    }
+};
+
+// Rows per panel so that two packed panels plus the unpacked one fit
+// in `resident_bytes`
+inline size_t stream_panel_rows(const MappedWeights& W, size_t resident_bytes) {
+    const size_t per_row = 2 * W.row_bytes() + W.cols();
+    return std::max<size_t>(1, resident_bytes / std::max<size_t>(1, per_row));
+}
+
+// =============================================================
+//  Streaming LUT GEMM — same contract as matmul_lut_fast, with W
+//  read from a MappedWeights panel by panel. Each panel is
+//  multiplied by the tiled LUT kernel straight into its rows of C.
+// =============================================================
+
+template <typename A, typename AAlloc>
+auto matmul_lut_stream(const MappedWeights& W,
+                       const std::vector<A, AAlloc>& A_mat,
+                       size_t N,
+                       const ProductLookupTable<uint8_t, A, int32_t>& lut,
+                       size_t resident_bytes = size_t(64) << 20,
+                       size_t block_size = 64,
+                       size_t num_threads = 4)
+{
+    const size_t M = W.rows(), K = W.cols();
+    if (A_mat.size() != K * N)
+        throw std::invalid_argument("matmul_lut_stream: activations size does not match K × N");
+    Matrix<int32_t, RowMajor, PlainStorage<int32_t>> C(M, N);
+    int32_t* Cd = C.data();
+    const size_t levels = lut.weight_levels();
+    const bool mirror = lut.mirrored();
+    const size_t panel = std::min(M, stream_panel_rows(W, resident_bytes));
+    std::vector<uint8_t> Wu(panel * K);
+
+    W.prefetch(0, panel);
+    for (size_t p0 = 0; p0 < M; p0 += panel) {
+        const size_t p1 = std::min(p0 + panel, M);
+        W.prefetch(p1, std::min(p1 + panel, M));   // overlaps the multiply below
+        {
+            TraceScope span("panel_unpack", "stream", "m0", int64_t(p0));
+            W.unpack_rows(p0, p1, Wu.data());
+        }
+        W.release(p0, p1);
+
+        const size_t rows = p1 - p0;
+        const TileShape shape = choose_tile_shape(rows, N, num_threads, {128, 256}, 64);
+        parallel_for_tiles(rows, N, shape, num_threads,
+            [&](size_t) {
+                return detail::LutPanel<A>(levels, std::min(shape.nc, N), mirror);
+            },
+            [&](const Tile& tile, detail::LutPanel<A>& local) {
+                detail::lut_accumulate_tile(&Wu[tile.m0 * K], Strides{K, 1},
+                                            &A_mat[tile.n0], Strides{N, 1},
+                                            Cd + (p0 + tile.m0) * N + tile.n0, N,
+                                            tile.rows(), K, tile.cols(), local, block_size);
+            });
+    }
+    return C;
+}
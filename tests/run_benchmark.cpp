@@ -3,12 +3,17 @@
 #include "../src/matrix.hpp"
 #include "../src/matrix_ops.hpp"
 #include "../src/lut_utils.hpp"
+#include "../src/dequant_gemm.hpp"
+#include "../src/perf_counters.hpp"
 
 #include <iostream>
 #include <chrono>
 #include <random>
 #include <cstring>
 #include <cstdlib>
+#include <iomanip>
+#include <memory>
+#include <thread>
 
 int main(int argc, char** argv) {
     // default prameters
@@ -16,6 +21,8 @@ int main(int argc, char** argv) {
     bool run_naive_int   = true;
     bool run_naive_float = true;
     bool run_lut         = true;
+    bool run_dequant     = true;
+    bool perf            = false;   // hardware counters + roofline
     #ifdef USE_MKL
         bool run_mkl = true;
     #else
@@ -26,13 +33,55 @@ int main(int argc, char** argv) {
         if      (strcmp(argv[i], "--m")==0)          M = std::atoi(argv[++i]);
         else if (strcmp(argv[i], "--k")==0)          K = std::atoi(argv[++i]);
         else if (strcmp(argv[i], "--n")==0)          N = std::atoi(argv[++i]);
-        else if (strcmp(argv[i], "--naive-only")==0) { run_naive_int = run_naive_float = run_lut = false; }
-        else if (strcmp(argv[i], "--lut-only")==0)   { run_lut = true; run_naive_int = run_naive_float = run_mkl = false; }
-        else if (strcmp(argv[i], "--mkl-only")==0)   { run_mkl = true; run_naive_int = run_naive_float = run_lut = false; }
+        else if (strcmp(argv[i], "--naive-only")==0) { run_naive_int = run_naive_float = run_lut = run_dequant = false; }
+        else if (strcmp(argv[i], "--lut-only")==0)   { run_lut = true; run_naive_int = run_naive_float = run_mkl = run_dequant = false; }
+        else if (strcmp(argv[i], "--mkl-only")==0)   { run_mkl = true; run_naive_int = run_naive_float = run_lut = run_dequant = false; }
+        else if (strcmp(argv[i], "--dequant-only")==0) { run_dequant = true; run_naive_int = run_naive_float = run_lut = run_mkl = false; }
+        else if (strcmp(argv[i], "--perf")==0)       perf = true;
     }
 
     std::cout << "[Shape] M=" << M << ", K=" << K << ", N=" << N << "\n\n";
 
+    // --perf: counters per kernel run, placed on the measured roofline.
+    // Intensity uses the LLC-miss traffic estimate when it is counted,
+    // otherwise the compulsory traffic (each operand read once, C written once).
+    Roofline roof;
+    std::unique_ptr<PerfCounters> counters;
+    if (perf) {
+        roof = measure_roofline(std::thread::hardware_concurrency());
+        counters = std::make_unique<PerfCounters>();
+        std::cout << std::fixed << std::setprecision(2)
+                  << "[roofline] peak " << roof.peak_gops << " Gop/s, "
+                  << roof.peak_gbps << " GB/s, ridge " << roof.ridge() << " op/B"
+                  << (counters->available() ? "" : " (perf counters unavailable)") << "\n\n"
+                  << std::defaultfloat << std::setprecision(6);
+    }
+    const double ops = 2.0 * M * K * N;
+    // Times fn() (`gemms` GEMMs of the shape); with --perf also prints
+    // counters and the roofline position
+    auto timed = [&](const char* label, double compulsory_bytes, auto&& fn, double gemms = 1.0) {
+        if (counters) counters->start();
+        auto t0 = std::chrono::high_resolution_clock::now();
+        fn();
+        auto t1 = std::chrono::high_resolution_clock::now();
+        double ms = std::chrono::duration<double,std::milli>(t1-t0).count();
+        std::cout << "[" << label << "] Time: " << ms << " ms\n";
+        if (!counters) return;
+        PerfSample s = counters->stop();
+        s.seconds = ms * 1e-3;
+        for (size_t e = 0; e < PerfSample::kEvents; ++e)
+            if (s.valid[e]) std::cout << "    " << perf_event_name(PerfEvent(e)) << ": " << s.value[e] << "\n";
+        const bool measured = s.dram_bytes() > 0;
+        RooflinePoint p = classify(gemms * ops, measured ? s.dram_bytes() : compulsory_bytes, s.seconds, roof);
+        std::cout << std::fixed << std::setprecision(2);
+        if (s.ipc() > 0) std::cout << "    IPC " << s.ipc() << "\n";
+        std::cout << "    " << p.gops << " Gop/s, " << p.gbps << " GB/s ("
+                  << (measured ? "LLC-miss estimate" : "compulsory") << "), intensity "
+                  << p.intensity << " op/B -> " << (p.memory_bound ? "memory" : "compute")
+                  << "-bound, " << 100.0 * p.efficiency() << "% of roof\n"
+                  << std::defaultfloat << std::setprecision(6);
+    };
+
     // random number generator
     std::mt19937 rng(12345);
     std::uniform_int_distribution<int> dist_int(0, 100);
@@ -60,11 +109,8 @@ int main(int argc, char** argv) {
 
     // === Naive int ===
     if (run_naive_int) {
-        auto t0 = std::chrono::high_resolution_clock::now();
-        auto C = matmul(A_i, B_i);
-        auto t1 = std::chrono::high_resolution_clock::now();
-        double ms = std::chrono::duration<double,std::milli>(t1-t0).count();
-        std::cout << "[ naive_int ] Time: " << ms << " ms\n";
+        timed(" naive_int ", 4.0 * (double(M)*K + double(K)*N + double(M)*N),
+              [&] { auto C = matmul(A_i, B_i); });
     }
 
     // === Naive float ===
@@ -77,20 +123,36 @@ int main(int argc, char** argv) {
             for (int j=0; j<N; ++j)
                 B_f.set(k,j, static_cast<float>(B_i.at(k,j)));
 
-        auto t0 = std::chrono::high_resolution_clock::now();
-        auto C = matmul(A_f, B_f);
-        auto t1 = std::chrono::high_resolution_clock::now();
-        double ms = std::chrono::duration<double,std::milli>(t1-t0).count();
-        std::cout << "[naive_float] Time: " << ms << " ms\n";
+        timed("naive_float", 4.0 * (double(M)*K + double(K)*N + double(M)*N),
+              [&] { auto C = matmul(A_f, B_f); });
     }
 
     // === Int4 LUT ===
     if (run_lut) {
-        auto t0 = std::chrono::high_resolution_clock::now();
-        auto C = matmul_lut_fast(Au, Bu, M, K, N, lut);
-        auto t1 = std::chrono::high_resolution_clock::now();
-        double ms = std::chrono::duration<double,std::milli>(t1-t0).count();
-        std::cout << "[    LUT    ] Time: " << ms << " ms\n";
+        // unpacked nibbles are one byte each
+        timed("    LUT    ", double(M)*K + double(K)*N + 4.0 * double(M)*N,
+              [&] { auto C = matmul_lut_fast(Au, Bu, M, K, N, lut); });
+
+        // three weights against the same activations (Q/K/V): separate
+        // GEMMs vs one table build per k shared by all three
+        const std::vector<const uint8_t*> Ws(3, Au.data());
+        const std::vector<size_t> Ms(3, size_t(M));
+        timed(" LUT 3 sep ", 3.0 * (double(M)*K + 4.0 * double(M)*N) + double(K)*N,
+              [&] { for (int w = 0; w < 3; ++w) auto C = matmul_lut_fast(Au, Bu, M, K, N, lut); }, 3.0);
+        timed(" LUT multi ", 3.0 * (double(M)*K + 4.0 * double(M)*N) + double(K)*N,
+              [&] { auto C = matmul_lut_multi(Ws, Ms, Bu, K, N, lut); }, 3.0);
+    }
+
+    // === Dequant (weights prepared once, outside the timed region) ===
+    if (run_dequant) {
+        DequantWeights Wd(Au.data(), nullptr, M, K);
+        std::vector<float> B_f(size_t(K) * N), C(size_t(M) * N);
+        for (int k=0; k<K; ++k)
+            for (int j=0; j<N; ++j)
+                B_f[size_t(k)*N + j] = static_cast<float>(B_i.at(k,j));
+
+        timed("  dequant  ", double(Wd.size_bytes()) + 4.0 * (double(K)*N + double(M)*N),
+              [&] { Wd.matmul(B_f.data(), C.data(), N); });
     }
 
 #ifdef USE_MKL
@@ -104,11 +166,8 @@ int main(int argc, char** argv) {
             for (int j=0; j<N; ++j)
                 B_f.set(k,j, static_cast<float>(B_i.at(k,j)));
 
-        auto t0 = std::chrono::high_resolution_clock::now();
-        auto C = matmul_mkl(A_f, B_f);
-        auto t1 = std::chrono::high_resolution_clock::now();
-        double ms = std::chrono::duration<double,std::milli>(t1-t0).count();
-        std::cout << "[    MKL    ] Time: " << ms << " ms\n";
+        timed("    MKL    ", 4.0 * (double(M)*K + double(K)*N + double(M)*N),
+              [&] { auto C = matmul_mkl(A_f, B_f); });
     }
 #endif
 
@@ -1,4 +1,8 @@
+import asyncio
+import threading
+
 import numpy as np
+import pytest
 import mpgemm
 
 def test_add_bias():
@@ -19,4 +23,315 @@ def test_measure_error():
     test = [1.1, 1.9, 2.5]
     stats = mpgemm.measure_error(ref, test)
     assert abs(stats["mse"] - 0.09) < 1e-6
-    assert abs(stats["max_error"] - 0.5) < 1e-6
\ No newline at end of file
+    assert abs(stats["max_error"] - 0.5) < 1e-6
+
+def test_w4a8_matches_naive():
+    M, K, N = 4, 8, 3
+    rng = np.random.default_rng(0)
+    w = rng.integers(0, 16, size=(M, K)).astype(np.uint8)
+    a = rng.integers(-127, 128, size=(K, N)).astype(np.float32)
+    a[0, :] = 127.0   # per-token scale of exactly 1
+    ref = mpgemm.Engine("naive").matmul(w.flatten().tolist(), a.flatten().tolist(), M, K, N)
+    out = mpgemm.Engine("w4a8").matmul(w.flatten().tolist(), a.flatten().tolist(), M, K, N)
+    assert np.allclose(out, ref)
+
+
+def test_matmul_fp16_io():
+    M, K, N = 5, 16, 7
+    rng = np.random.default_rng(3)
+    w = rng.integers(0, 16, size=(M, K)).astype(np.uint8)
+    a = rng.standard_normal((K, N)).astype(np.float16)
+    e = mpgemm.Engine("w4a8")
+    ref = np.array(e.matmul(w.flatten().tolist(), a.astype(np.float32).flatten().tolist(), M, K, N),
+                   dtype=np.float32)
+    out16 = e.matmul_fp16(w.flatten().tolist(), a, M, K, N)
+    out32 = e.matmul_fp16(w.flatten().tolist(), a, M, K, N, out_fp16=False)
+    assert out16.dtype == np.float16 and out32.dtype == np.float32
+    assert np.array_equal(out32, ref)
+    assert np.array_equal(out16, ref.astype(np.float16))
+
+def test_matmul_transposed_operands():
+    M, K, N = 6, 40, 3
+    rng = np.random.default_rng(5)
+    w = rng.integers(0, 16, size=(M, K)).astype(np.uint8)
+    a = rng.standard_normal((K, N)).astype(np.float32)
+    for backend in ("w4a8", "dequant"):
+        e = mpgemm.Engine(backend)
+        ref = e.matmul(w.flatten().tolist(), a.flatten().tolist(), M, K, N)
+        # W stored K × M, A stored token-major (N × K)
+        out = e.matmul(w.T.flatten().tolist(), a.T.flatten().tolist(), M, K, N,
+                       trans_w=True, trans_a=True)
+        assert np.allclose(out, ref, atol=1e-4)
+
+def test_matmul_multi_shared_activation():
+    K, N = 32, 5
+    Ms = [8, 4, 4]
+    rng = np.random.default_rng(9)
+    ws = [rng.integers(0, 16, size=(m, K)).astype(np.uint8) for m in Ms]
+    a = rng.integers(-8, 8, size=(K, N)).astype(np.float32)
+    e = mpgemm.Engine("lut")
+    e.generate_lut(bit_width=4)
+    outs = e.matmul_multi([w.flatten().tolist() for w in ws], Ms, a.flatten().tolist(), K, N)
+    assert len(outs) == len(ws)
+    for w, m, out in zip(ws, Ms, outs):
+        ref = e.matmul(w.flatten().tolist(), a.flatten().tolist(), m, K, N)
+        assert np.array_equal(np.array(out), np.array(ref))
+
+def test_low_bit_lut_weights():
+    M, K, N = 12, 30, 4
+    rng = np.random.default_rng(10)
+    a = rng.integers(-8, 8, size=(K, N)).astype(np.float32)
+    e = mpgemm.Engine("lut")
+    for bits in (1, 2, 3, 4):
+        e.generate_lut(bit_width=bits)
+        codes = rng.integers(0, 1 << bits, size=(M, K)).astype(np.uint8)
+        signed = np.where(codes < (1 << (bits - 1)), codes, codes.astype(np.int32) - (1 << bits))
+        out = np.array(e.matmul(codes.flatten().tolist(), a.flatten().tolist(), M, K, N))
+        assert np.array_equal(out.reshape(M, N), (signed @ a).astype(np.float32))
+    with pytest.raises(ValueError):
+        e.generate_lut(bit_width=5)
+
+def test_trace_export(tmp_path):
+    import json
+    M, K, N = 64, 32, 8
+    w = np.random.randint(0, 16, size=(M, K), dtype=np.uint8)
+    a = np.random.randint(-8, 8, size=(K, N)).astype(np.float32)
+    e = mpgemm.Engine("lut")
+    e.generate_lut(bit_width=4)
+    mpgemm.clear_trace()
+    mpgemm.set_tracing(True)
+    e.matmul(w.flatten().tolist(), a.flatten().tolist(), M, K, N)
+    mpgemm.set_tracing(False)
+    path = tmp_path / "trace.json"
+    mpgemm.write_trace(str(path))
+    events = json.loads(path.read_text())["traceEvents"]
+    names = {ev["name"] for ev in events}
+    assert {"prepare", "compute", "tile", "lut_build"} <= names
+    assert all(ev["ph"] == "X" and ev["dur"] >= 0 for ev in events)
+    mpgemm.clear_trace()
+
+def test_engine_benchmark():
+    e = mpgemm.Engine("dequant")
+    res = e.benchmark(methods=["lut", "naive", "dequant"], num_runs=3, shapes=[(16, 32, 8)])
+    assert [r["method"] for r in res] == ["lut", "naive", "dequant"]
+    for r in res:
+        assert r["runs"] == 3 and 0 < r["min_ms"] <= r["median_ms"] <= r["p95_ms"]
+        assert r["gflops"] > 0 and r["error"]["max_error"] == 0.0
+    w = np.random.randint(0, 16, size=(4, 8), dtype=np.uint8)
+    a = np.random.randn(8, 2).astype(np.float32)
+    own = e.benchmark(num_runs=2, shapes=[(4, 8, 2)],
+                      weights=w.flatten().tolist(), activations=a.flatten().tolist())
+    assert len(own) == 1 and own[0]["method"] == "dequant"
+    assert own[0]["error"]["max_error"] < 1e-4
+
+def test_matmul_stream_from_file(tmp_path):
+    M, K, N = 40, 33, 4
+    rng = np.random.default_rng(13)
+    w = rng.integers(0, 16, size=(M, K)).astype(np.uint8)
+    a = rng.integers(-8, 8, size=(K, N)).astype(np.float32)
+    path = str(tmp_path / "w.w4")
+    mpgemm.write_weight_file(path, w.flatten().tolist(), M, K)
+    mw = mpgemm.MappedWeights(path)
+    assert (mw.rows, mw.cols) == (M, K)
+    e = mpgemm.Engine("lut")
+    e.generate_lut(bit_width=4)
+    ref = e.matmul(w.flatten().tolist(), a.flatten().tolist(), M, K, N)
+    out = e.matmul_stream(mw, a.flatten().tolist(), N, resident_bytes=256)
+    assert np.array_equal(np.array(out), np.array(ref))
+
+def _tp_worker(name, world, rank, shard, M, K, mode):
+    tp = mpgemm.ShmTensorParallel(name, world, rank, shard, M, K, mode, max_n=8)
+    tp.serve()
+
+def test_shm_tensor_parallel_rows_and_k():
+    import multiprocessing as mp
+    import os
+    M, K, N, world = 12, 20, 4, 3
+    rng = np.random.default_rng(11)
+    w = rng.integers(0, 16, size=(M, K)).astype(np.uint8)
+    a = rng.integers(-8, 8, size=(K, N)).astype(np.float32)
+    ref = mpgemm.Engine("lut")
+    ref.generate_lut(4)
+    expect = np.array(ref.matmul(w.flatten().tolist(), a.flatten().tolist(), M, K, N))
+
+    ctx = mp.get_context("fork")
+    for mode in (mpgemm.ShardMode.Rows, mpgemm.ShardMode.K):
+        def shard(r):
+            if mode == mpgemm.ShardMode.Rows:
+                b, e = mpgemm.ShmTensorParallel.shard_range(M, world, r)
+                return w[b:e].flatten().tolist()
+            b, e = mpgemm.ShmTensorParallel.shard_range(K, world, r)
+            return w[:, b:e].flatten().tolist()
+        name = f"mpgemm_pytest_{os.getpid()}"
+        procs = [ctx.Process(target=_tp_worker, args=(name, world, r, shard(r), M, K, mode))
+                 for r in range(1, world)]
+        for p in procs:
+            p.start()
+        tp = mpgemm.ShmTensorParallel(name, world, 0, shard(0), M, K, mode, max_n=8)
+        out = np.array(tp.matmul(a.flatten().tolist(), N))
+        del tp
+        for p in procs:
+            p.join(timeout=30)
+            assert p.exitcode == 0
+        assert np.array_equal(out, expect)
+
+def test_weight_cache_and_registered_weights():
+    M, K, N = 8, 12, 3
+    rng = np.random.default_rng(5)
+    w = rng.integers(0, 16, size=(M, K)).astype(np.uint8)
+    a = rng.integers(-8, 8, size=(K, N)).astype(np.float32)
+    e = mpgemm.Engine("w4a8")
+    expect = e.matmul(w.flatten().tolist(), a.flatten().tolist(), M, K, N)
+    e.set_weight_cache(1 << 20)
+    for _ in range(3):
+        assert e.matmul(w.flatten().tolist(), a.flatten().tolist(), M, K, N) == expect
+    s = e.weight_cache_stats()
+    assert (s["hits"], s["misses"], s["entries"]) == (2, 1, 1)
+    h = e.register_weights(w.flatten().tolist(), M, K)
+    assert (h.rows, h.cols) == (M, K)
+    assert e.matmul(h, a.flatten().tolist(), N) == expect
+
+def test_huge_pages():
+    M, K, N = 1024, 1024, 4   # 1 MiB of weights: the smallest huge-page block
+    rng = np.random.default_rng(6)
+    w = rng.integers(0, 16, size=(M, K)).astype(np.uint8).flatten().tolist()
+    a = rng.integers(-8, 8, size=(K, N)).astype(np.float32).flatten().tolist()
+    expect = mpgemm.Engine("w4a8").matmul(w, a, M, K, N)
+    before = mpgemm.huge_page_report()
+    mpgemm.set_huge_pages(mpgemm.HugePages.Transparent, 1 << 20)
+    try:
+        e = mpgemm.Engine("w4a8")
+        e.set_weight_cache(16 << 20)
+        assert e.matmul(w, a, M, K, N) == expect
+        r = mpgemm.huge_page_report()
+        assert r["allocations"] > before["allocations"]
+        assert r["thp_bytes"] + r["hugetlb_bytes"] <= r["requested_bytes"]
+        assert 0.0 <= r["huge_fraction"] <= 1.0
+    finally:
+        mpgemm.set_huge_pages(mpgemm.HugePages.Off)
+
+def test_engine_shared_across_threads():
+    rng = np.random.default_rng(7)
+    cases = []
+    for t in range(4):
+        M, K, N = 16 + 8 * t, 32 + 16 * t, 2 + t
+        w = rng.integers(0, 16, size=M * K).astype(np.uint8).tolist()
+        a = rng.integers(-8, 8, size=K * N).astype(np.float32).tolist()
+        cases.append((w, a, M, K, N))
+    for backend in ("lut", "w4a8", "dequant"):
+        e = mpgemm.Engine(backend)
+        if backend == "lut":
+            e.generate_lut(4)
+        expect = [e.matmul(*c) for c in cases]
+        errors = []
+
+        def worker(t):
+            for _ in range(5):
+                if e.matmul(*cases[t]) != expect[t]:
+                    errors.append(t)
+
+        threads = [threading.Thread(target=worker, args=(t,)) for t in range(len(cases))]
+        for th in threads:
+            th.start()
+        for th in threads:
+            th.join()
+        assert not errors
+
+def test_dequant_weights_reuse():
+    M, K, N = 3, 5, 2
+    rng = np.random.default_rng(1)
+    w = rng.integers(0, 16, size=(M, K)).astype(np.uint8)
+    scales = np.array([0.5, 1.0, 2.0], dtype=np.float32)
+    signed = np.where(w < 8, w, w.astype(np.int32) - 16).astype(np.float32)
+    ref_w = signed * scales[:, None]
+    Wd = mpgemm.DequantWeights(w.flatten().tolist(), scales.tolist(), M, K)
+    for _ in range(2):
+        a = rng.standard_normal((K, N)).astype(np.float32)
+        out = np.array(Wd.matmul(a.flatten().tolist(), N)).reshape(M, N)
+        assert np.allclose(out, ref_w @ a, atol=1e-4)
+
+
+def test_measure_error_numpy_and_streaming():
+    rng = np.random.default_rng(2)
+    ref = rng.standard_normal(1000).astype(np.float32)
+    test = ref + np.float32(0.01) * rng.standard_normal(1000).astype(np.float32)
+    whole = mpgemm.measure_error(ref, test)
+    assert abs(whole["mse"] - np.mean((test - ref) ** 2)) < 1e-9
+    assert whole["cosine"] > 0.999
+    assert sum(whole["histogram"]) == 1000
+
+    acc = mpgemm.ErrorAccumulator()
+    for lo in range(0, 1000, 300):
+        acc.update(ref[lo:lo + 300], test[lo:lo + 300])
+    tiled = acc.stats()
+    assert abs(tiled["mse"] - whole["mse"]) < 1e-12
+    assert tiled["max_error"] == whole["max_error"]
+
+    bad = test.copy()
+    bad[7] = np.nan
+    nan = mpgemm.measure_error(ref, bad)
+    assert nan["nonfinite"] == 1 and nan["histogram"][-1] >= 1
+    assert np.isinf(nan["max_error"])
+
+
+def test_submit_matches_matmul():
+    M, K, N = 4, 6, 3
+    rng = np.random.default_rng(3)
+    eng = mpgemm.Engine("w4a8")
+    done = threading.Event()
+    calls = []
+    jobs = []
+    for _ in range(4):
+        w = rng.integers(0, 16, size=M * K).tolist()
+        a = rng.standard_normal(K * N).tolist()
+        jobs.append((w, a, eng.submit(w, a, M, K, N)))
+    eng.submit(jobs[0][0], jobs[0][1], M, K, N,
+               callback=lambda f: (calls.append(f.result()), done.set()))
+    for w, a, fut in jobs:
+        assert np.allclose(fut.result(), eng.matmul(w, a, M, K, N))
+    assert done.wait(10) and len(calls) == 1
+
+
+def test_submit_async_awaitable():
+    M, K, N = 2, 4, 2
+    eng = mpgemm.Engine("naive")
+    w = [1] * (M * K)
+    a = [1.0] * (K * N)
+
+    async def run():
+        return await eng.submit_async(w, a, M, K, N)
+
+    out = asyncio.run(run())
+    assert np.allclose(out, [4.0] * (M * N))
+
+
+def test_linear_graph_runs_layers():
+    rng = np.random.default_rng(4)
+    d0, d1, d2, n = 6, 5, 3, 2
+    w1 = rng.integers(0, 16, size=(d1, d0)).astype(np.uint8)
+    w2 = rng.integers(0, 16, size=(d2, d1)).astype(np.uint8)
+    b1 = rng.standard_normal(d1).astype(np.float32)
+    x = rng.standard_normal((d0, n)).astype(np.float32)
+
+    g = mpgemm.LinearGraph("dequant")
+    g.add_linear(w1.flatten().tolist(), d1, d0, bias=b1.tolist(), act=mpgemm.Activation.ReLU)
+    g.add_linear(w2.flatten().tolist(), d2, d1)
+    out = np.array(g.run(x.flatten().tolist(), n)).reshape(d2, n)
+
+    s = lambda w: np.where(w < 8, w, w.astype(np.int32) - 16).astype(np.float32)
+    h = np.maximum(s(w1) @ x + b1[:, None], 0)
+    assert np.allclose(out, s(w2) @ h, atol=1e-4)
+    assert len(g.layer_times_ms()) == 2
+
+def test_codebook_weights_beat_uniform():
+    M, K, N = 16, 64, 5
+    rng = np.random.default_rng(7)
+    w = rng.standard_normal((M, K)).astype(np.float32)
+    a = rng.standard_normal((K, N)).astype(np.float32)
+    cw = mpgemm.CodebookWeights(w.flatten().tolist(), M, K, group_rows=4)
+    wq = np.array(cw.dequantize()).reshape(M, K)
+    out = np.array(cw.matmul(a.flatten().tolist(), N)).reshape(M, N)
+    assert np.allclose(out, wq @ a, rtol=1e-4, atol=1e-4)
+    nf4 = mpgemm.CodebookWeights(w.flatten().tolist(), M, K, group_rows=4, iters=0)
+    assert np.mean((wq - w) ** 2) <= np.mean((np.array(nf4.dequantize()).reshape(M, K) - w) ** 2)
+    assert mpgemm.CodebookWeights(w.flatten().tolist(), M, K).group_rows == 64